@@ -0,0 +1,70 @@
+//
+//  Arena.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// One allocation, carved into cache-line aligned arrays.
+// build() runs the layout twice: once to add up the sizes, once to hand
+// out the pointers, so the list of arrays is only written in one place.
+// Meant for start(); only trivially destructible types go in.
+class Arena
+{
+public:
+
+	enum { LINE = 64 };
+
+	// layout(arena) calls take<T>(count) for every array, in a fixed order
+	template<typename F>
+	void build(F&& layout)
+	{
+		planning = true;
+		used = 0;
+		layout(*this);
+
+		memory.reset(new unsigned char[used + LINE]);
+		base = memory.get() + (LINE - reinterpret_cast<std::uintptr_t>(memory.get()) % LINE) % LINE;
+
+		planning = false;
+		used = 0;
+		layout(*this);
+	}
+
+	// count value-initialised Ts, on a line of their own
+	template<typename T>
+	T* take(std::size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "nothing in the arena gets destroyed");
+		static_assert(alignof(T) <= LINE, "lines are the coarsest alignment on offer");
+
+		const std::size_t at = used;
+		used += (count * sizeof(T) + LINE - 1) / LINE * LINE;
+		if(planning)
+			return nullptr;
+
+		T* first = reinterpret_cast<T*>(base + at);
+		for (std::size_t i = 0; i < count; ++i)
+			new (first + i) T();
+		return first;
+	}
+
+	// bytes handed out, padding included
+	std::size_t size() const { return used; }
+
+private:
+	std::unique_ptr<unsigned char[]> memory;
+	unsigned char* base = nullptr;
+	std::size_t used = 0;
+	bool planning = false;
+};
\ No newline at end of file
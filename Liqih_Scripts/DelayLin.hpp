@@ -14,20 +14,32 @@
 //	(at your option) any later version. 
 
 
+// T is the stored sample type: float for the usual path,
+// double when the feedback loop should run in full precision.
+// The line does not own its samples: attach() points it at BUF_SIZE of
+// them, so the owner decides where they live, e.g. one block for all lines.
+template<typename T = float>
 class DelayLin
 {
 public:
-	DelayLin() { flush(); }
+	DelayLin() {}
+
+	void attach(T* memory)
+	{
+		buffer = memory;
+		write = 0;
+		flush();
+	}
 
 	void flush() 
 	{  
 		for (int i = 0; i < BUF_SIZE; i++)	
 		{
-			buffer[i] = 0.0f;
+			buffer[i] = T(0);
 		}
 	}		
 
-	float readAt(double samples)
+	T readAt(double samples)
 	{
 		int	iIndex = int(samples);
 		const double fIndex = samples-iIndex;
@@ -37,13 +49,13 @@ public:
 		if (iIndex < 0) iIndex += BUF_SIZE;// wrap
 		assert(iIndex >= 0);
 
-		float	x0 = buffer[iIndex & BUF_MASK];
-		float	x1 = buffer[(iIndex + 1) & BUF_MASK];
+		T	x0 = buffer[iIndex & BUF_MASK];
+		T	x1 = buffer[(iIndex + 1) & BUF_MASK];
 
-		return float(x0 + (x1 - x0) * fIndex);
+		return T(x0 + (x1 - x0) * fIndex);
 
 	}	
-	void writeSample(float input)
+	void writeSample(T input)
 	{
 		buffer[write] = input; 		
 		if( ++write > BUF_MASK )  write = 0; 	
@@ -53,6 +65,6 @@ public:
 
 
 private:
-	float buffer[BUF_SIZE];			
+	T* buffer = nullptr;			
 	int write = 0;	
 };
\ No newline at end of file
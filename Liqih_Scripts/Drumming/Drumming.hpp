@@ -3,6 +3,8 @@
 #include "waveshape_oscillator.hpp"
 #include "audioFilePlayer.hpp"
 #include "audioBufferOps.hpp"
+#include "groove.hpp"
+#include "../Snapshot.hpp"
 
 using namespace ape;
 
@@ -46,12 +48,25 @@ public:
 	Param<File> fileParam1{ "File1", { "Kick", "Snare", "Hihat1", "Hihat2" } };
 	Param<float> speed1{ "Speed1", Range(0.01, 10, Range::Exp) };
 	Param<float> volume1{ "Volume1" };	
+	Param<GrooveTable::Template> groove1{ "Groove1", GrooveTable::templateNames };
+	Param<float> swing1{ "Swing1" };
 
 	Param<Rate> rate2 { "Rate2", rateNames };
 	Param<float> offset2{ "offset2" , Range(0, 45) };
 	Param<File> fileParam2{ "File2", { "Kick", "Snare", "Hihat1", "Hihat2" } };
 	Param<float> speed2{ "Speed2", Range(0.01, 10, Range::Exp) };
 	Param<float> volume2{ "Volume2" };
+	Param<GrooveTable::Template> groove2{ "Groove2", GrooveTable::templateNames };
+	Param<float> swing2{ "Swing2" };
+
+	Param<float> humanise{ "Humanise" };
+	Param<int> seed{ "Seed", Range(0, 99) };
+
+	Param<float> morph{ "Morph" }; // scene A -> scene B
+	Param<bool> storeA{ "StoreA" };
+	Param<bool> storeB{ "StoreB" };
+	Param<bool> recallA{ "RecallA" };
+	Param<bool> recallB{ "RecallB" };
 	
 	MeteredValue left = MeteredValue("<");
 	MeteredValue right = MeteredValue(">");
@@ -60,17 +75,32 @@ public:
 	{
 		phase1 = 90;
 		phase2 = 90;
-		rate1 = Rate::_1_4;
-		rate2 = Rate::_1_6;
-
-		volume1 = 0.4f;
-		speed1 = 0.8f;	
-		volume2 = 0.5f;
-		speed2 = 1.2f;	
+		defaults();
 	}
 
 private:
 
+	// both players, then the shared humanisation
+	auto preset()
+	{
+		return std::tie(rate1, offset1, fileParam1, speed1, volume1, groove1, swing1,
+			rate2, offset2, fileParam2, speed2, volume2, groove2, swing2, humanise, seed);
+	}
+	using Preset = Snapshot<16>;
+
+	static constexpr Preset factory {{
+		float(int(Rate::_1_4)), 0.0f, 0.0f, 0.8f, 0.4f, 0.0f, 1.0f,
+		float(int(Rate::_1_6)), 0.0f, 0.0f, 1.2f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f
+	}};
+	Scenes<Preset::COUNT> scenes;
+
+	// starting preset, once: a restart keeps whatever the user set
+	void defaults()
+	{
+		std::apply([](auto&... p) { factory.recall(p...); }, preset());
+	}
+	static constexpr auto noState = [](auto&&) {}; // timing comes from the transport, nothing to bring back
+
 	//The files must exist in the same folder fo this C++ file
 	std::vector<AudioFile> files {		
 		"KICK 1 CLOSE.wav",
@@ -81,17 +111,22 @@ private:
 
 	AudioFilePlayer audioFilePlayer1;
 	AudioFilePlayer audioFilePlayer2;
-	AudioFilePlayer audioFilePlayer3;
-	AudioFilePlayer audioFilePlayer4;
 
 	std::vector<float> channel1;
 	std::vector<float> channel2;
 
 	std::vector<int> trigger1;
 	std::vector<int> trigger2;
+	std::vector<float> velocity1;
+	std::vector<float> velocity2;
+
+	GrooveTable grooveTable1;
+	GrooveTable grooveTable2;
 
 	double phase1 = 0;
 	double phase2 = 0;
+	long long step1 = 0; // cycles since the song start, picks the groove step
+	long long step2 = 0;
 	bool run = false;
 
 	static double ratioMultiply(Rate r, double input)
@@ -100,21 +135,32 @@ private:
 		return (input * ratio.numerator) / ratio.denominator;
 	}
 
+	static int stepsPerBar(Rate r, int numerator, int denominator)
+	{
+		const double cycles = ratioMultiply(r, numerator) / denominator;
+		return (int)std::lround(cycles);
+	}
+
 	void start(const IOConfig& cfg) override
 	{	
 		channel1.resize(cfg.maxBlockSize);
 		channel2.resize(cfg.maxBlockSize);
 		trigger1.resize(cfg.maxBlockSize);
 		trigger2.resize(cfg.maxBlockSize);
+		velocity1.resize(cfg.maxBlockSize);
+		velocity2.resize(cfg.maxBlockSize);
+
+		std::apply([&](auto&... p) { scenes.reset(morph, noState, p...); }, preset());
 	}
 
 	void process(umatrix<const float> inputs, umatrix<float> outputs, size_t frames) override
 	{
 		assert(outputs.channels() == 2);
 
-		const auto shared = sharedChannels();
 		const auto SR = config().sampleRate;
 
+		std::apply([&](auto&... p) { scenes.update(storeA, storeB, recallA, recallB, morph, noState, p...); }, preset());
+
 		auto position = getPlayHeadPosition();
 
 		// The fundamental frequency of the project's "tempo"
@@ -125,38 +171,52 @@ private:
 
 		if(timeLocked && position.isPlaying)
 		{
-			auto revolutions1 = fundamental * (ratioMultiply(rate1, position.timeInSamples) / SR);
+			auto revolutions1 = fundamental * (ratioMultiply(rate1, position.timeInSamples) / SR) + offset1;
 			// do range reduction while in normalized frequency
-			phase1 = (revolutions1 - (long long)revolutions1) +  offset1;
+			step1 = (long long)revolutions1;
+			phase1 = revolutions1 - step1;
 
-			auto revolutions2 = fundamental * (ratioMultiply(rate2, position.timeInSamples) / SR);
+			auto revolutions2 = fundamental * (ratioMultiply(rate2, position.timeInSamples) / SR) + offset2;
 			// do range reduction while in normalized frequency
-			phase2 = (revolutions2 - (long long)revolutions2) +  offset2; 
+			step2 = (long long)revolutions2;
+			phase2 = revolutions2 - step2;
 
 			run = true;
 		}		
 
+		// the bar only gets rebuilt when rate, meter or groove settings moved
+		const float parhumanise = humanise;
+		const int parseed = seed;
+		grooveTable1.update(stepsPerBar(rate1, position.timeSigNumerator, position.timeSigDenominator), groove1, swing1, parhumanise, parseed);
+		grooveTable2.update(stepsPerBar(rate2, position.timeSigNumerator, position.timeSigDenominator), groove2, swing2, parhumanise, parseed + 1);
+
 		double rotation1 = ratioMultiply(rate1, fundamental) / SR;
 		double rotation2 = ratioMultiply(rate2, fundamental) / SR;
 
 		for (std::size_t n = 0; n < frames; ++n)
 		{
-			for (std::size_t c = 0; c < shared; ++c) // why both channels?
-			{
-				// phase lock oscillators with relationship)
-				trigger1[n] = (run && Osc::eval(phase1, Osc::Shape::Pulse) > 0.99f) ? 1 : 0;
-				trigger2[n] = (run && Osc::eval(phase2, Osc::Shape::Pulse) > 0.99f) ? 1 : 0;	
-			}
+			// phase lock oscillators with relationship), each step fires late by its groove delay
+			const auto& hit1 = grooveTable1.at(step1);
+			const auto& hit2 = grooveTable2.at(step2);
+			const double local1 = phase1 - hit1.delay;
+			const double local2 = phase2 - hit2.delay;
+
+			trigger1[n] = (run && local1 >= 0 && Osc::eval(local1, Osc::Shape::Pulse) > 0.99f) ? 1 : 0;
+			trigger2[n] = (run && local2 >= 0 && Osc::eval(local2, Osc::Shape::Pulse) > 0.99f) ? 1 : 0;	
+			velocity1[n] = hit1.velocity;
+			velocity2[n] = hit2.velocity;
 
 			phase1 += rotation1;
-			phase1 -= (int)phase1;
+			if(phase1 >= 1) { phase1 -= (int)phase1; ++step1; }
 
 			phase2 += rotation2;
-			phase2 -= (int)phase2;
+			if(phase2 >= 1) { phase2 -= (int)phase2; ++step2; }
 		}
 
 		audioFilePlayer1.setTriggers(&trigger1);
 		audioFilePlayer2.setTriggers(&trigger2);					
+		audioFilePlayer1.setVelocities(&velocity1);
+		audioFilePlayer2.setVelocities(&velocity2);
 
 		if(files.empty())
 			abort("no files to play");
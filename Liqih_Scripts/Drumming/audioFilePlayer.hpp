@@ -1,4 +1,5 @@
 #include <misc.h>
+#include <consts.h>
 
 using namespace ape;
 
@@ -6,6 +7,15 @@ class AudioFilePlayer
 {
 public:
 
+	// Resample: speed moves pitch and length together.
+	// Stretch: speed only moves the pitch, the length follows setStretch(),
+	// the file is rebuilt from overlapping grains aligned WSOLA style.
+	enum class Mode
+	{
+		Resample,
+		Stretch
+	};
+
 	AudioFilePlayer() {}
 
 	void setFile(AudioFile* which)
@@ -20,9 +30,30 @@ public:
 	{
 		loop = value;	
 	}
+	void setReverse( bool value)
+	{
+		reverse = value;
+	}
+	void setMode( Mode value)
+	{
+		mode = value;
+	}
+	// duration factor in Stretch mode, 2 plays the slice twice as long
+	void setStretch( float value)
+	{
+		stretch = std::max(value, 0.01f);
+	}
+	// fractions of the file, the slice is what plays, loops and reverses
+	void setSlice( float startAt, float endAt)
+	{
+		sliceStart = std::clamp(startAt, 0.0f, 1.0f);
+		sliceEnd = std::clamp(endAt, sliceStart, 1.0f);
+	}
 	void start()
 	{
 		position = 0;
+		untilGrain = 0;
+		aligned = false;
 	}
 
 	void setTriggers(std::vector<int>* ptr)
@@ -30,6 +61,18 @@ public:
 		trigger = ptr;
 	}
 
+	// optional, the gain of each hit is latched when its trigger fires
+	void setVelocities(std::vector<float>* ptr)
+	{
+		velocity = ptr;
+	}
+
+	// length of the slice in file samples, for callers fitting it to a tempo
+	fpoint sliceSamples() const
+	{
+		return file ? fpoint(sliceEnd - sliceStart) * file->samples() : 0;
+	}
+
 	bool blockPlayFile(std::vector<float>& buffer, size_t frames, float sampleRate, float gain)
 	{	
 		if(!file)
@@ -39,26 +82,44 @@ public:
 
 		circular_signal<const float> signal = (*file)[0];
 
+		const fpoint first = std::floor(sliceStart * file->samples());
+		const fpoint length = std::max<fpoint>(std::floor(sliceEnd * file->samples()) - first, 1);
+		const fpoint last = first + length - 1;
+
+		if(mode == Mode::Stretch)
+			return blockStretch(buffer, frames, sampleRate, ratio, gain, signal, first, length, last);
+
+		fpoint history[4]; // the taps of hermite4()
+
 		auto interpolate = [&] (fpoint frac)
 		{	
 			return hermite4(frac, history[xm1], history[x0], history[x1], history[x2]);	
 		};
 
-		const bool ok = (trigger != 0) && (trigger->size() <= frames);
+		const bool ok = (trigger != 0) && (trigger->size() >= frames);
+		const bool accents = (velocity != 0) && (velocity->size() >= frames);
+
+		// reversed, the history is read backwards and the fraction mirrored
+		const long long dir = reverse ? -1 : 1;
 
 		for(size_t i = 0; i < frames; ++i)
 		{			
-			if(ok && trigger->at(i) == 1) position = 0;
-			const auto x = static_cast<long long>(position);
-			const auto frac = position - x;
-			const auto offset = -2;
+			if(ok && trigger->at(i) == 1)
+			{
+				position = 0;
+				if(accents) hitGain = velocity->at(i);
+			}
+			const fpoint index = reverse ? last - position : first + position;
+			const auto x = static_cast<long long>(reverse ? std::ceil(index) : std::floor(index));
+			const auto frac = (index - x) * dir;
+			const auto offset = -1;
 
-			for(size_t h = 0; h < 7; ++h) 
-				history[h] = signal(x + h + offset);  // not all history[] used by hermite4()		
+			for(size_t h = 0; h < 4; ++h) 
+				history[h] = signal(x + ((long long)h + offset) * dir);
 
-			if(position < file->samples())
+			if(position < length)
 			{
-				buffer[i] = interpolate(frac)*gain;
+				buffer[i] = interpolate(frac)*gain*hitGain;
 			}
 			else
 			{
@@ -67,8 +128,8 @@ public:
 
 			position += ratio * speed;
 
-			while(loop && position >= file->samples()) 
-				position -= file->samples(); // loop
+			while(loop && position >= length) 
+				position -= length; // loop
 
 		}
 
@@ -79,23 +140,239 @@ private:
 
 	enum H
 	{
-		xm2,
 		xm1,
 		x0,
 		x1,
 		x2,
-		x3,
 	};
 
-	uint64_t counter = 0;
-	fpoint position = 0;
+	// a grain is a Hann windowed read of the file at the playback pitch
+	struct Grain
+	{
+		fpoint source; // file index of its first sample
+		fpoint step;   // file samples per output sample, negative in reverse
+		float gain;
+		long long age; // output samples since its onset, negative before it
+		const float* shape; // window, or opening for the first grain of a hit
+	};
+
+	struct Onset
+	{
+		size_t at;
+		fpoint position;
+		float gain;
+		bool restart;
+	};
+
+	enum
+	{
+		MAX_GRAIN = 4096,
+		MAX_GRAINS = 8,
+		MAX_ONSETS = 64,
+		SEARCH_STRIDE = 8,
+		EDGE_FADE = 64 // file samples, where a grain runs into the end of an unlooped slice
+	};
+
+	static constexpr float GRAIN_SECONDS = 0.04f;
+
+	// grains last 40 ms and overlap by half, the periodic Hann sums to one;
+	// the opening shape is flat until the next grain takes over, so a hit
+	// comes in at full level instead of fading in
+	void setGrainLength(float sampleRate)
+	{
+		if(sampleRate == grainRate)
+			return;
+
+		grainRate = sampleRate;
+		grainLength = std::clamp((int)(GRAIN_SECONDS * sampleRate) & ~1, 64, (int)MAX_GRAIN);
+		hop = grainLength / 2;
+		for(int k = 0; k < grainLength; ++k)
+		{
+			window[k] = 0.5f - 0.5f * std::cos(consts<float>::tau * k / grainLength);
+			opening[k] = k < hop ? 1.0f : window[k];
+		}
+	}
+
+	// a hermite read whose taps never leave the slice, held at its ends
+	static float read(circular_signal<const float>& signal, fpoint index, fpoint first, fpoint last)
+	{
+		const long long lo = static_cast<long long>(first), hi = static_cast<long long>(last);
+		auto tap = [&](long long i) { return fpoint(signal(std::clamp(i, lo, hi))); };
+
+		const auto x = static_cast<long long>(std::floor(index));
+		return float(hermite4(index - x, tap(x - 1), tap(x), tap(x + 1), tap(x + 2)));
+	}
+
+	// the same read with every tap folded back into the slice, for looping
+	static float readLooped(circular_signal<const float>& signal, fpoint index, fpoint first, fpoint length)
+	{
+		const long long base = static_cast<long long>(first), span = static_cast<long long>(length);
+		auto tap = [&](long long i) { return fpoint(signal(base + ((i - base) % span + span) % span)); };
+
+		const fpoint at = index - std::floor((index - first) / length) * length;
+		const auto x = static_cast<long long>(std::floor(at));
+		return float(hermite4(at - x, tap(x - 1), tap(x), tap(x + 1), tap(x + 2)));
+	}
+
+	// WSOLA: slide the new grain within +-tolerance so it lines up with
+	// what the previous grain would have played next; it never starts outside the slice
+	fpoint align(circular_signal<const float>& signal, fpoint nominal, fpoint step, fpoint first, fpoint last) const
+	{
+		const int taps = hop / SEARCH_STRIDE;
+		float natural[MAX_GRAIN / 2 / SEARCH_STRIDE];
+		for(int k = 0; k < taps; ++k)
+			natural[k] = signal(static_cast<long long>(std::floor(previous.source + (hop + k * SEARCH_STRIDE) * previous.step)));
+
+		const int tolerance = hop / 4;
+		fpoint best = nominal;
+		float score = -1e30f;
+		for(int delta = -tolerance; delta <= tolerance; delta += SEARCH_STRIDE)
+		{
+			const fpoint candidate = nominal + delta;
+			if(candidate < first || candidate > last)
+				continue;
+			float sum = 0.0f;
+			for(int k = 0; k < taps; ++k)
+				sum += natural[k] * signal(static_cast<long long>(std::floor(candidate + k * SEARCH_STRIDE * step)));
+			if(sum > score)
+			{
+				score = sum;
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	bool blockStretch(std::vector<float>& buffer, size_t frames, float sampleRate, fpoint ratio, float gain,
+		circular_signal<const float>& signal, fpoint first, fpoint length, fpoint last)
+	{
+		setGrainLength(sampleRate);
+
+		const bool ok = (trigger != 0) && (trigger->size() >= frames);
+		const bool accents = (velocity != 0) && (velocity->size() >= frames);
+		const fpoint advance = ratio / stretch; // slice samples consumed per output sample
+		const fpoint step = ratio * speed * (reverse ? -1 : 1);
+
+		std::fill(buffer.begin(), buffer.begin() + frames, 0.0f);
 
-	fpoint history[7] {};
+		// one hop at a time: each stretch of the block starts at most one regular
+		// grain, so the pool never drops a grain that still has audio to give,
+		// however large the block
+		for(size_t done = 0; done < frames; done += hop)
+		{
+			const size_t chunk = std::min(frames - done, (size_t)hop);
+
+			// grain onsets for this chunk, worked out before any audio is touched
+			size_t onsets = 0;
+			for(size_t i = 0; i < chunk; ++i)
+			{
+				const bool hit = ok && trigger->at(done + i) == 1;
+				if(hit)
+				{
+					position = 0;
+					untilGrain = 0;
+					if(accents) hitGain = velocity->at(done + i);
+				}
+				if(untilGrain == 0 && position < length && onsets < MAX_ONSETS)
+				{
+					schedule[onsets++] = { i, position, hitGain, hit };
+					untilGrain = hop;
+				}
+				if(untilGrain > 0) --untilGrain;
 
+				position += advance;
+				while(loop && position >= length)
+					position -= length; // loop
+			}
+
+			for(size_t e = 0; e < onsets; ++e)
+			{
+				const Onset& o = schedule[e];
+				const fpoint nominal = reverse ? last - o.position : first + o.position;
+
+				// a hit starts on the nominal sample and at full level so the transient stays put
+				if(o.restart) aligned = false;
+				const fpoint source = aligned ? align(signal, nominal, step, first, last) : nominal;
+				const float* shape = aligned ? window : opening;
+
+				if(live == MAX_GRAINS) // drop the oldest, only under a burst of triggers
+				{
+					std::copy(grains + 1, grains + live, grains);
+					--live;
+				}
+				grains[live++] = { source, step, o.gain, -(long long)o.at, shape };
+				previous = grains[live - 1];
+				aligned = true;
+			}
+
+			size_t kept = 0;
+			for(size_t g = 0; g < live; ++g)
+			{
+				Grain& grain = grains[g];
+				const size_t from = (size_t)std::max(-grain.age, 0LL);
+				const long long k0 = grain.age + (long long)from;
+				const size_t count = std::min(chunk - from, (size_t)(grainLength - k0));
+
+				// gather first, then a plain multiply-add the compiler can vectorise.
+				// Grains start inside the slice and only run away from where they
+				// started, so only the far edge needs care: looping wraps the reads,
+				// otherwise they fade out before crossing it
+				if(loop)
+				{
+					for(size_t j = 0; j < count; ++j)
+						scratch[j] = readLooped(signal, grain.source + (k0 + (long long)j) * grain.step, first, length);
+				}
+				else
+				{
+					for(size_t j = 0; j < count; ++j)
+					{
+						const fpoint at = grain.source + (k0 + (long long)j) * grain.step;
+						const fpoint room = reverse ? at - first : last - at;
+						const float fade = (float)std::clamp<fpoint>(room / EDGE_FADE, 0, 1);
+						scratch[j] = fade > 0.0f ? read(signal, at, first, last) * fade : 0.0f;
+					}
+				}
+
+				float* out = buffer.data() + done + from;
+				const float* win = grain.shape + k0;
+				const float level = grain.gain * gain;
+				for(size_t j = 0; j < count; ++j)
+					out[j] += win[j] * scratch[j] * level;
+
+				grain.age += chunk;
+				if(grain.age < grainLength)
+					grains[kept++] = grain;
+			}
+			live = kept;
+		}
+
+		return true;
+	}
+
+	// touched every sample in either mode
+	fpoint position = 0;
 	float speed = 1.0f;	
+	float hitGain = 1.0f;
 	bool loop = false;
+	bool reverse = false;
+	Mode mode = Mode::Resample;
+	float stretch = 1.0f;
+	float sliceStart = 0.0f, sliceEnd = 1.0f;
 	AudioFile* file = 0;
 
-	std::vector<float> buffer;
 	std::vector<int>* trigger = 0;
+	std::vector<float>* velocity = 0;
+
+	// Stretch mode only, kept last so the lines above stay together
+	Grain grains[MAX_GRAINS] {};
+	size_t live = 0;
+	Grain previous {};
+	bool aligned = false;
+	long long untilGrain = 0;
+	Onset schedule[MAX_ONSETS] {};
+	int grainLength = 0, hop = 0;
+	float grainRate = 0.0f;
+	float window[MAX_GRAIN] {};
+	float opening[MAX_GRAIN] {};
+	float scratch[MAX_GRAIN] {};
 };
\ No newline at end of file
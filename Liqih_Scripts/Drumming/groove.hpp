@@ -0,0 +1,107 @@
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+using namespace ape;
+
+// Per-bar timing table for one lane of triggers.
+// Everything is worked out when the pattern changes, so while playing
+// a trigger costs one lookup of its step.
+class GrooveTable
+{
+public:
+
+	enum class Template
+	{
+		Straight,
+		Swing,
+		Shuffle,
+		LaidBack,
+		Accent
+	};
+
+	static constexpr Param<Template>::Names templateNames {
+		"Straight", "Swing", "Shuffle", "LaidBack", "Accent"
+	};
+
+	struct Step
+	{
+		double delay;	// in steps, always in [0, 0.5)
+		float velocity;
+	};
+
+	enum { MAX_STEPS = 64 };
+
+	// cheap when nothing changed, otherwise rebuilds the whole bar
+	void update(int stepsPerBar, Template shape, float amount, float humanise, int seed)
+	{
+		stepsPerBar = std::clamp(stepsPerBar, 1, (int)MAX_STEPS);
+
+		if(stepsPerBar == steps && shape == key.shape && amount == key.amount
+			&& humanise == key.humanise && seed == key.seed)
+			return;
+
+		steps = stepsPerBar;
+		key = { shape, amount, humanise, seed };
+
+		uint32_t rng = 0x9E3779B9u ^ (uint32_t)seed * 2654435761u;
+		auto random = [&rng] // xorshift, same bar for the same seed on every machine
+		{
+			rng ^= rng << 13;
+			rng ^= rng >> 17;
+			rng ^= rng << 5;
+			return (rng >> 8) * (1.0f / 16777216.0f);
+		};
+
+		for (int s = 0; s < steps; ++s)
+		{
+			const Step base = pattern(shape, s);
+			const double jitter = humanise * 0.1 * random();
+			const float accent = humanise * 0.3f * (random() * 2.0f - 1.0f);
+
+			table[s].delay = std::min(base.delay * amount + jitter, 0.49);
+			table[s].velocity = std::clamp(1.0f + (base.velocity - 1.0f) * amount + accent, 0.0f, 1.0f);
+		}
+	}
+
+	const Step& at(long long step) const
+	{
+		const long long s = step % steps;
+		return table[s < 0 ? s + steps : s];
+	}
+
+private:
+
+	// one cycle of each template, at full amount
+	static Step pattern(Template shape, int s)
+	{
+		switch (shape)
+		{
+		case Template::Swing: // off-steps land on the triplet
+			return s & 1 ? Step{ 1.0 / 3, 0.8f } : Step{ 0, 1.0f };
+		case Template::Shuffle:
+		{
+			static constexpr Step cycle[4] { { 0, 1.0f }, { 1.0 / 3, 0.7f }, { 0, 0.9f }, { 1.0 / 6, 0.7f } };
+			return cycle[s & 3];
+		}
+		case Template::LaidBack: // all but the downbeat drag behind
+			return s == 0 ? Step{ 0, 1.0f } : Step{ 0.08, 0.9f };
+		case Template::Accent:
+			return Step{ 0, s == 0 ? 1.0f : (s & 1 ? 0.6f : 0.8f) };
+		case Template::Straight:
+		default:
+			return Step{ 0, 1.0f };
+		}
+	}
+
+	struct Key
+	{
+		Template shape;
+		float amount, humanise;
+		int seed;
+	};
+
+	Step table[MAX_STEPS] {};
+	int steps = 0;
+	Key key {};
+};
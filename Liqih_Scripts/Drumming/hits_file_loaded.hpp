@@ -20,10 +20,20 @@ public:
 	Param<File> fileParam1{ "File1", { "Kick", "Snare", "Hihat1", "Hihat2" } };
 	Param<float> speed1{ "Speed1", Range(0.001, 10, Range::Exp) };
 	Param<float> volume1{ "Volume1" };
+	Param<bool> reverse1{ "Reverse1" };
+	Param<float> start1{ "Start1" };
+	Param<float> end1{ "End1" };
+	Param<int> beats1{ "Beats1", Range(0, 16) }; // 0 plays once, otherwise a loop stretched to the tempo
 	
 	Param<File> fileParam2{ "File2", { "Kick", "Snare", "Hihat1", "Hihat2" } };
 	Param<float> speed2{ "Speed2", Range(0.001, 10, Range::Exp) };
 	Param<float> volume2{ "Volume2" };
+	Param<bool> reverse2{ "Reverse2" };
+	Param<float> start2{ "Start2" };
+	Param<float> end2{ "End2" };
+	Param<int> beats2{ "Beats2", Range(0, 16) };
+
+	Param<float> bpm{ "BPM", Range(40, 240) }; // a generator has no play head, so the tempo is set here
 
 	HitsPlaying()
 	{
@@ -31,6 +41,9 @@ public:
 		speed1 = 1.0f;	
 		volume2 = 0.5f;
 		speed2 = 1.0f;		
+		end1 = 1.0f;
+		end2 = 1.0f;
+		bpm = 120.0f;
 	}
 
 private:
@@ -45,8 +58,6 @@ private:
 
 	AudioFilePlayer audioFilePlayer1;
 	AudioFilePlayer audioFilePlayer2;
-	AudioFilePlayer audioFilePlayer3;
-	AudioFilePlayer audioFilePlayer4;
 	
 	std::vector<float> channel1;
 	std::vector<float> channel2;
@@ -77,6 +88,26 @@ private:
 		}
 	}
 	
+	// Beats > 0: the slice loops, fitted to that many beats without moving its pitch,
+	// speed is then a pure transposition. Beats = 0 keeps the plain resampling player.
+	void setupPlayer(AudioFilePlayer& player, AudioFile& file, float speed, bool reverse,
+		float startAt, float endAt, int beats, float sampleRate)
+	{
+		player.setFile(&file);
+		player.setSpeed(speed);
+		player.setReverse(reverse);
+		player.setSlice(startAt, endAt);
+		player.setLoop(beats > 0);
+		player.setMode(beats > 0 ? AudioFilePlayer::Mode::Stretch : AudioFilePlayer::Mode::Resample);
+
+		if(beats > 0)
+		{
+			const double target = beats * 60.0 / bpm * sampleRate; // output samples
+			const double natural = player.sliceSamples() * sampleRate / file.sampleRate();
+			player.setStretch(float(target / std::max(natural, 1.0)));
+		}
+	}
+
 	void start(const IOConfig& cfg) override
 	{
 	
@@ -97,18 +128,16 @@ private:
 		if(volume1 > 0.0f)
 		{
 		
-			audioFilePlayer1.setSpeed(speed1);
 			auto& file = files[(int)(File)fileParam1];		
-			audioFilePlayer1.setFile(&file);
+			setupPlayer(audioFilePlayer1, file, speed1, reverse1, start1, end1, beats1, sampleRate);
 			audioFilePlayer1.blockPlayFile(channel1, frames, sampleRate, volume1);
 			copyToStereo(channel1, buffer, frames);
 		}
 		
 		if(volume2 > 0.0f)
 		{
-			audioFilePlayer2.setSpeed(speed2);
 			auto& file = files[(int)(File)fileParam2];		
-			audioFilePlayer2.setFile(&file);				
+			setupPlayer(audioFilePlayer2, file, speed2, reverse2, start2, end2, beats2, sampleRate);
 			audioFilePlayer2.blockPlayFile(channel2, frames, sampleRate, volume2);
 			addToStereo(channel2, buffer, frames);
 		}
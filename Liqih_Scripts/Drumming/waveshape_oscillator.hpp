@@ -1,67 +1,12 @@
 #include <generator.h>
 #include <consts.h>
+#include "../SubBlock.hpp"
+#include "../StatelessOscillator.hpp"
 
 using namespace ape;
 
 GlobalData(WaveshapeOscillator, "");
 
-template<typename T>
-struct StatelessOscillator
-{
-	enum class Shape
-	{
-		Sine,
-		Triangle,
-		SawDown,
-		SawUp,
-		Square,
-		Pulse,
-	};
-
-	static constexpr typename Param<Shape>::Names ShapeNames = {
-		"Sine", "Triangle", "SawDown", "SawUp", "Square", "Pulse"
-	};
-
-	static T eval(double unitPhase, Shape s)
-	{
-		T sample;
-
-		// Do range reduction to simplify oscillators
-		unitPhase = unitPhase - (long long)unitPhase;
-		// calculate the sample here, depending on the type
-		// note that all but the sine is mathematically ideal,
-		// in a way that will alias extremely much.
-		// but they are quick and demonstrates the use.
-		// see the additive synthesizer for a correct way to do this
-		switch (s)
-		{
-		case Shape::Sine: // sine
-			sample = std::cos(consts<T>::tau * unitPhase);
-			break;
-		case Shape::Triangle: // triangle
-			if (unitPhase < consts<T>::half)
-				sample = -1 + 4 * unitPhase;
-			else
-				sample = 1 - 4 * (unitPhase - consts<T>::half);
-			break;
-		case Shape::SawDown: // sawtooth
-			sample = 1 - unitPhase * 2;
-			break;
-		case Shape::SawUp: // sawtooth
-			sample = -1 + unitPhase * 2;
-			break;
-		case Shape::Square: // square
-			sample = unitPhase < consts<T>::half ? 1 : -1;
-			break;
-		case Shape::Pulse: // short positive pulse
-			sample = unitPhase < 0.01? 1 : 0;
-			break;
-		}
-
-		return sample;
-	}
-};
-
 /// <summary>
 /// Simple controller for <see cref="StatelessOscillator{T}"/>
 /// </summary>
@@ -97,9 +42,13 @@ private:
 		Param<Osc::Shape> shape { "Shape", Osc::ShapeNames };
 
 		double phase = 0;
+		fpoint gain = 0; // ramps linearly towards dB::from(volume) across each sub-block
+		fpoint gainStep = 0;
 	};
 
 	State osc[kNumOscillators];
+	fpoint normalized = 0;
+	SubBlock clock;
 
 	void process(umatrix<float> buffer, size_t frames) override
 	{
@@ -112,27 +61,37 @@ private:
 			std::pow(C::two, osc[2].ratio / twelve) / reduction
 		};
 
-		for (size_t n = 0; n < frames; ++n)
+		clock.forEach(frames, [&](size_t offset, size_t count, bool boundary)
 		{
-			auto normalized = frequency[n] / config().sampleRate;
-
-			fpoint sample = 0;
-			
-			for (size_t o = 0; o < kNumOscillators; ++o)
+			if(boundary)
 			{
-				// dB per sample is very computationally heavy.
-				const auto volume = dB::from(osc[o].volume[n]);
-				sample += Osc::eval(osc[o].phase, osc[o].shape) * volume;
+				normalized = frequency[offset] / config().sampleRate;
 
-				osc[o].phase += normalized * ratios[o];
-				osc[o].phase -= (int)osc[o].phase;
+				// dB per sample is very computationally heavy, so once per sub-block it is.
+				for (size_t o = 0; o < kNumOscillators; ++o)
+					osc[o].gainStep = (dB::from(osc[o].volume[offset]) - osc[o].gain) / SubBlock::SIZE;
 			}
 
-			for (size_t c = 0; c < buffer.channels(); ++c)
+			for (size_t n = offset; n < offset + count; ++n)
 			{
-				buffer[c][n] = sample;
+				fpoint sample = 0;
+				
+				for (size_t o = 0; o < kNumOscillators; ++o)
+				{
+					osc[o].gain += osc[o].gainStep;
+					sample += Osc::eval(osc[o].phase, osc[o].shape) * osc[o].gain;
+
+					osc[o].phase += normalized * ratios[o];
+					osc[o].phase -= (int)osc[o].phase;
+				}
+
+				for (size_t c = 0; c < buffer.channels(); ++c)
+				{
+					buffer[c][n] = sample;
+				}
 			}
+		});
 
-		}
+		clock.advance(frames);
 	}
 };
\ No newline at end of file
@@ -20,6 +20,11 @@
 #include <effect.h>
 #include <consts.h>
 #include "DelayLin.hpp"
+#include "SubBlock.hpp"
+#include "WorkerPool.hpp"
+#include "Snapshot.hpp"
+#include "Arena.hpp"
+#include "StatelessOscillator.hpp"
 
 using namespace ape;
 
@@ -34,11 +39,48 @@ public:
 	Param<float>    HPHz{ 		"HPHz", 	Range(20, 1900, Range::Exp) };
 	Param<float>    fdbk{  		"repeat",   Range(0, 1) };
 	Param<float>    wet{   		"dry/wet", 	Range(0, 1) };
+	Param<float>    duck{  		"duck", 	Range(0, 1) }; // wet ducking under the key
+	Param<float>    duckAttack{ "duckAttack", "ms", Range(0.1, 100, Range::Exp) };
+	Param<float>    duckRelease{ "duckRelease", "ms", Range(10, 2000, Range::Exp) };
+	Param<bool>     duckRMS{ 	"duckRMS" };
+	Param<bool>     sidechain{ 	"sidechain" }; // key from the input pair after the main ones
+	Param<float>    wow{ 		"wow", 		Range(0, 1) }; // slow tape speed drift
+	Param<float>    wowRate{ 	"wowRate", "Hz", Range(0.1, 4, Range::Exp) };
+	Param<float>    flutter{ 	"flutter", 	Range(0, 1) }; // fast capstan wobble
+	Param<float>    diffuse{ 	"diffuse", 	Range(0, 1) }; // allpass smear on every repeat
+	Param<bool>     parallel{ 	"parallel" }; // spread wide buses over worker threads, taken at start()
+	Param<float>    morph{ 		"morph", 	Range(0, 1) }; // scene A -> scene B
+	Param<bool>     storeA{ 	"storeA" };
+	Param<bool>     storeB{ 	"storeB" };
+	Param<bool>     recallA{ 	"recallA" }; // scene A with its filter and glide state
+	Param<bool>     recallB{ 	"recallB" };
+
+	MeteredValue    footprint = MeteredValue("memory (bytes)"); // object, hot arena and delay memory, set in start()
 
 	Echoing() {}
 
 private:
 
+	// delay lines, filters and glide; double for very long feedback tails
+	using Real = float;
+
+	// sidechain, parallel and the scene controls stay out
+	auto preset() { return std::tie(length, spreadXch, LPHz, HPHz, fdbk, wet, duck, duckAttack, duckRelease, duckRMS,
+		wow, wowRate, flutter, diffuse); }
+	using Preset = Snapshot<14>;
+
+	// starting preset
+	static constexpr Preset factory {{ 0.5f, 0.25f, 4400.0f, 37.0f, 0.87f, 1.0f, 0.0f, 5.0f, 250.0f, 0.0f, 0.0f, 0.6f, 0.0f, 0.0f }};
+
+	using Osc = StatelessOscillator<Real>;
+
+	enum { DIFFUSERS = 4 };
+	static constexpr float FLUTTER_HZ = 7.0f;
+	static constexpr float WOW_MS = 5.0f, FLUTTER_MS = 0.2f; // peak delay swing at full depth
+	static constexpr float diffuserMs[DIFFUSERS] { 4.77f, 3.59f, 2.53f, 1.63f }; // odd channels x 1.09
+	static constexpr Real DIFFUSER_GAIN = Real(0.6);
+
+	template<typename T>
 	class P1Filter
 	{
 	public:
@@ -49,89 +91,308 @@ private:
 		void setFreq(float fHz, float sr)
 		{
 			if(sr < 22050.0f) sr = 22050.0f;
-			b1 = std::exp(-consts<float>::tau * fHz / sr);
+			b1 = std::exp(-consts<T>::tau * fHz / sr);
 			a0 = 1 - b1;
 		}	
-		float filterLP(float sample)
+		T filterLP(T sample)
 		{
 			state = sample * a0 + state * b1;
 			return	state;
 		}
-		float filterHP(float sample)
+		T filterHP(T sample)
 		{
 			state = sample * a0 + state * b1;
 			return	sample - state;
 		}
 
 	private:
-		float state;
-		float a0, b1;	
+		T state;
+		T a0, b1;	
 	};
 	
 
-	std::vector<P1Filter>  HPfilter;
-	std::vector<P1Filter>  LPfilter;
-	std::vector<P1Filter>  DCfilter1;
-	std::vector<P1Filter> Smoothing;	 
-	std::vector<DelayLin>  Lines;
-	const float maxSamples = float(DelayLin::BUF_MASK);	
+	// Envelope follower on the key signal, turned into a wet gain per sample.
+	class Ducker
+	{
+	public:
+
+		void flush() { env = 0; }
+
+		void setTimes(float attackMs, float releaseMs, float sr)
+		{
+			attack = 1 - std::exp(-1000.0f / (attackMs * sr));
+			release = 1 - std::exp(-1000.0f / (releaseMs * sr));
+		}
+
+		// keys are channels [first, first + count) of inputs
+		void run(umatrix<const float>& inputs, std::size_t first, std::size_t count, size_t frames, bool rms, Real depth, Real* gain)
+		{
+			// detector, linked over the key channels: no sample depends on another
+			for (std::size_t n = 0; n < frames; ++n)
+				gain[n] = 0;
+			for (std::size_t c = first; c < first + count; ++c)
+			{
+				if(rms)
+					for (std::size_t n = 0; n < frames; ++n)
+						gain[n] += Real(inputs[c][n]) * inputs[c][n] / count;
+				else
+					for (std::size_t n = 0; n < frames; ++n)
+						gain[n] = std::max(gain[n], Real(std::fabs(inputs[c][n])));
+			}
+
+			// follower, the only recursive part
+			for (std::size_t n = 0; n < frames; ++n)
+			{
+				const Real key = gain[n];
+				env += (key - env) * (key > env ? attack : release);
+				const Real level = rms ? std::sqrt(env) : env;
+				gain[n] = 1 - depth * std::min(level * 4, Real(1)); // fully ducked from -12 dBFS
+			}
+		}
+
+	private:
+		Real env = 0;
+		Real attack = 1, release = 1;
+	};
+
+	// control values, picked up once per sub-block
+	struct Control
+	{
+		float length, LPHz, HPHz;
+		Real fdbk, wet;
+		Real wow, flutter, diffuse; // depths in samples, diffusion mix
+		double wowPhase, wowStep, flutterPhase; // at the start of the span
+	};
+
+	// everything a channel touches per sample, kept together on whole cache lines
+	struct alignas(64) Lane
+	{
+		P1Filter<Real> HPfilter, LPfilter, DCfilter1, Smoothing;
+		DelayLin<Real> line;
+		Real delayTime = 0, delayStep = 0; // glides linearly across each sub-block
+		Real* diffuser[DIFFUSERS] {}; // allpass memories, next to the delay's
+		int at[DIFFUSERS] {};
+	};
+
+	Arena hot;   // lanes, control table and duck gains, walked every block
+	Arena lines; // delay and diffuser memory, only a few points of it are touched per sample
+	Lane* lanes = nullptr;
+	Control* controls = nullptr;
+	Real* duckGain = nullptr; // per sample, for the whole block
+	Ducker ducker;
+	Control held {};
+	SubBlock clock;
+	WorkerPool pool;
+	Scenes<Preset::COUNT> scenes;
+	int diffuserLength[2][DIFFUSERS] {}; // even and odd channels
+	double wowPhase = 0, flutterPhase = 0;
+	std::size_t channels = 0; // lanes built in start()
+	const float maxSamples = float(DelayLin<Real>::BUF_MASK);	
 
 	void start(const IOConfig& cfg) override
 	{ 
-		// starting preset
-		length = 0.5f;
-		spreadXch = 0.25f;
-		HPHz = 37.0f;
-		LPHz = 4400.0f;
-		fdbk = 0.87f;
-		wet = 1.0f;
-
-		HPfilter.resize(cfg.inputs);
-		LPfilter.resize(cfg.inputs);
-		DCfilter1.resize(cfg.inputs);
-		Smoothing.resize(cfg.inputs);
-		Lines.resize(cfg.inputs);
+		std::apply([](auto&... p) { factory.recall(p...); }, preset());
+
+		hot.build([&](Arena& a)
+		{
+			lanes = a.take<Lane>(cfg.inputs);
+			controls = a.take<Control>(SubBlock::maxSpans(cfg.maxBlockSize));
+			duckGain = a.take<Real>(cfg.maxBlockSize);
+		});
+		const float sr = cfg.sampleRate;
+		std::size_t diffusion = 0; // allpass memory per channel
+		for (int k = 0; k < DIFFUSERS; ++k)
+		{
+			diffuserLength[0][k] = std::max(1, int(diffuserMs[k] * 0.001f * sr));
+			diffuserLength[1][k] = std::max(1, int(diffuserMs[k] * 1.09f * 0.001f * sr));
+			diffusion += diffuserLength[1][k];
+		}
+
+		Real* memory = nullptr;
+		Real* smear = nullptr;
+		channels = cfg.inputs;
+		lines.build([&](Arena& a)
+		{
+			memory = a.take<Real>(cfg.inputs * DelayLin<Real>::BUF_SIZE);
+			smear = a.take<Real>(cfg.inputs * diffusion);
+		});
+		footprint = float(sizeof(*this) + hot.size() + lines.size());
+		ducker.flush();
+		clock.reset();
+		pool.start(parallel ? WorkerPool::suggested(cfg.inputs) : 0, 1.5 * cfg.maxBlockSize / cfg.sampleRate);
+		wowPhase = flutterPhase = 0;
+
 		for (std::size_t c = 0; c < cfg.inputs; ++c)
 		{
-			Lines[c].flush();
-		}		
+			lanes[c].line.attach(memory + c * DelayLin<Real>::BUF_SIZE);
+			lanes[c].DCfilter1.setFreq(40.0f, sr);
+			lanes[c].Smoothing.setFreq(2.0f*SubBlock::SIZE, sr); // 2 Hz, stepped once per sub-block
+
+			Real* next = smear + c * diffusion;
+			for (int k = 0; k < DIFFUSERS; ++k)
+			{
+				lanes[c].diffuser[k] = next;
+				next += diffuserLength[c & 1][k];
+			}
+		}
+
+		// both scene slots start out as the factory preset on a fresh state
+		std::apply([&](auto&... p) { scenes.reset(morph, [this](auto&& keep) { state(keep); }, p...); }, preset());
+	}
+
+	// what a scene brings back besides the Param<>s, the delay memory stays as it is
+	template<typename F>
+	void state(F&& keep)
+	{
+		for (std::size_t c = 0; c < channels; ++c)
+		{
+			keep(lanes[c].HPfilter);
+			keep(lanes[c].LPfilter);
+			keep(lanes[c].DCfilter1);
+			keep(lanes[c].Smoothing);
+			keep(lanes[c].delayTime);
+			keep(lanes[c].delayStep);
+		}
+		keep(ducker);
+		keep(wowPhase);
+		keep(flutterPhase);
+	}
+
+	// Schroeder allpasses in series, blended in by amount
+	Real diffuseRepeat(Lane& lane, const int* lengths, Real x, Real amount)
+	{
+		Real y = x;
+		for (int k = 0; k < DIFFUSERS; ++k)
+		{
+			Real& d = lane.diffuser[k][lane.at[k]];
+			const Real w = y + DIFFUSER_GAIN * d;
+			y = d - DIFFUSER_GAIN * w;
+			d = w;
+			if(++lane.at[k] == lengths[k]) lane.at[k] = 0;
+		}
+		return x + (y - x) * amount;
 	}
 
 	void process(umatrix<const float> inputs, umatrix<float> outputs, size_t frames) override
 	{		
 		const auto shared = sharedChannels();
-		const float parWet = wet;		
-		const float parLPHz = LPHz;
-		const float parHPHz = HPHz;
-		const float parspreadXch = spreadXch;
-		const float parfdbk = fdbk*0.998f;		
-
-		
-		for (std::size_t c = 0; c < shared; ++c)
-		{	
-			const float sr = config().sampleRate;
-			HPfilter[c].setFreq(parHPHz, sr);
-			LPfilter[c].setFreq(parLPHz, sr);
-			DCfilter1[c].setFreq(40.0f, sr);
-			Smoothing[c].setFreq(2.0f, sr);	
-				
-			for (std::size_t n = 0; n < frames; ++n)
-			{			
-				auto parlength = length[n]; // lerp by APE
-				parlength += c&1 ? parspreadXch : 0.0f; // even channels offset
-				parlength = std::clamp(parlength, 0.0f, 1.0f);			
 
-				const float out = Lines[c].readAt(maxSamples*Smoothing[c].filterLP(parlength)); 
+		std::apply([&](auto&... p) { scenes.update(storeA, storeB, recallA, recallB, morph, [this](auto&& keep) { state(keep); }, p...); }, preset());
 
-				const float inS = inputs[c][n];
-				const float inF = inS + parfdbk * HPfilter[c].filterHP(LPfilter[c].filterLP(out));
+		const float parspreadXch = spreadXch;
+		const Real parduck = duck;
 
-				Lines[c].writeSample(inF);
+		const bool ducked = parduck > 0;
+		if(ducked)
+		{
+			const auto& cfg = config();
+			const bool keyed = sidechain && cfg.inputs >= cfg.outputs + 2;
+			ducker.setTimes(duckAttack, duckRelease, cfg.sampleRate);
+			ducker.run(inputs, keyed ? cfg.outputs : 0, keyed ? 2 : shared, frames, duckRMS, parduck, duckGain);
+		}
 
-				outputs[c][n] = DCfilter1[c].filterHP(inF*parWet+(1.0f-parWet)*inS); 
+		// control rate: one set of values per sub-block, the LFO phases per span
+		const float sr = config().sampleRate;
+		const double flutterStep = FLUTTER_HZ / sr;
+		bool modulated = false, diffused = false;
+		std::size_t spans = 0;
+		clock.forEach(frames, [&](std::size_t offset, std::size_t count, bool boundary)
+		{
+			if(boundary)
+			{
+				held = { length[offset], LPHz[offset], HPHz[offset], fdbk[offset]*0.998f, wet[offset], // lerp by APE
+					wow[offset] * WOW_MS * 0.001f * sr, flutter[offset] * FLUTTER_MS * 0.001f * sr, diffuse[offset],
+					0, wowRate[offset] / sr, 0 };
 			}
-		} 
+			held.wowPhase = wowPhase;
+			held.flutterPhase = flutterPhase;
+			controls[spans++] = held;
+
+			modulated |= held.wow > 0 || held.flutter > 0;
+			diffused |= held.diffuse > 0;
+			wowPhase += count * held.wowStep;
+			wowPhase -= (int)wowPhase;
+			flutterPhase += count * flutterStep;
+			flutterPhase -= (int)flutterPhase;
+		});
+
+		// ducking, modulation and diffusion each drop out of the loop when off
+		using Kernel = void (Echoing::*)(std::size_t, float, umatrix<const float>&, umatrix<float>&, size_t);
+		static constexpr Kernel kernels[8] {
+			&Echoing::processChannel<false, false, false>, &Echoing::processChannel<true, false, false>,
+			&Echoing::processChannel<false, true, false>,  &Echoing::processChannel<true, true, false>,
+			&Echoing::processChannel<false, false, true>,  &Echoing::processChannel<true, false, true>,
+			&Echoing::processChannel<false, true, true>,   &Echoing::processChannel<true, true, true>
+		};
+		const auto kernel = kernels[ducked + 2 * modulated + 4 * diffused];
 
+		// channels are independent, so wide buses can be cut into groups
+		const std::size_t groups = parallel && WorkerPool::worth(frames, shared) ? std::min(shared, pool.size() + 1) : 1;
+		auto group = [&](std::size_t g)
+		{
+			for (std::size_t c = g * shared / groups; c < (g + 1) * shared / groups; ++c)
+				(this->*kernel)(c, c&1 ? parspreadXch : 0.0f, inputs, outputs, frames); // even channels offset
+		};
+		pool.parallelFor(groups, group);
+
+		clock.advance(frames);
 		clear(outputs, shared);
 	}
-};
+
+	template<bool Ducked, bool Modulated, bool Diffused>
+	void processChannel(std::size_t c, float spread, umatrix<const float>& inputs, umatrix<float>& outputs, size_t frames)
+	{
+		const float sr = config().sampleRate;
+		const double flutterStep = FLUTTER_HZ / sr;
+		const int* lengths = diffuserLength[c & 1];
+		Lane& lane = lanes[c];
+		Real time = lane.delayTime;
+		Real step = lane.delayStep;
+		Real swing[SubBlock::SIZE], flutters[SubBlock::SIZE];
+		std::size_t s = 0;
+
+		clock.forEach(frames, [&](std::size_t offset, std::size_t count, bool boundary)
+		{
+			const Control& ctl = controls[s++];
+
+			if(boundary)
+			{
+				lane.HPfilter.setFreq(ctl.HPHz, sr);
+				lane.LPfilter.setFreq(ctl.LPHz, sr);
+
+				const float parlength = std::clamp(ctl.length + spread, 0.0f, 1.0f);
+				const Real target = maxSamples*lane.Smoothing.filterLP(parlength);
+				step = (target - time) / SubBlock::SIZE;
+			}
+
+			// both LFOs for the whole span, odd channels a quarter turn apart
+			if(Modulated)
+			{
+				const double skew = c & 1 ? 0.25 : 0.0;
+				Osc::block(ctl.wowPhase + skew, ctl.wowStep, Osc::Shape::Sine, swing, count);
+				Osc::block(ctl.flutterPhase + skew, flutterStep, Osc::Shape::Sine, flutters, count);
+				for (std::size_t n = 0; n < count; ++n)
+					swing[n] = swing[n] * ctl.wow + flutters[n] * ctl.flutter;
+			}
+
+			for (std::size_t n = offset; n < offset + count; ++n)
+			{			
+				time += step;
+				const Real at = Modulated ? std::clamp(time + swing[n - offset], Real(1), Real(maxSamples)) : time;
+				const Real out = lane.line.readAt(at); 
+
+				const Real inS = inputs[c][n];
+				const Real back = lane.HPfilter.filterHP(lane.LPfilter.filterLP(out));
+				const Real inF = inS + ctl.fdbk * (Diffused ? diffuseRepeat(lane, lengths, back, ctl.diffuse) : back);
+
+				lane.line.writeSample(inF);
+
+				const Real inW = Ducked ? inS + (inF - inS)*duckGain[n] : inF; // only the repeats duck
+				outputs[c][n] = float(lane.DCfilter1.filterHP(inW*ctl.wet+(1-ctl.wet)*inS)); 
+			}
+		});
+
+		lane.delayTime = time;
+		lane.delayStep = step;
+	}
+};
\ No newline at end of file
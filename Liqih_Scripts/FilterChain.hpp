@@ -0,0 +1,90 @@
+//
+//  FilterChain.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <cmath>
+#include <consts.h>
+
+using namespace ape;
+
+// Input LP -> HP one-poles plus the two 40 Hz DC blockers of the output,
+// with all the state of one channel packed in a single cache line.
+// The two identical DC one-poles are folded into one second-order section:
+// p(1-z^-1)/(1-pz^-1) squared = p^2(1-z^-1)^2/(1-pz^-1)^2
+template<typename T>
+class FilterChain
+{
+public:
+
+	struct Coefs
+	{
+		T lpA0 = 0, lpB1 = 0, hpA0 = 0, hpB1 = 0;
+	};
+
+	struct alignas(64) Lane
+	{
+		T lp = 0, hp = 0; // one-pole states
+		T z1 = 0, z2 = 0; // DC section, transposed direct form II
+	};
+
+	void setSampleRate(float sampleRate)
+	{
+		sr = sampleRate < 22050.0f ? 22050.0f : sampleRate;
+		const T p = pole(40.0f);
+		g = p*p;
+		a1 = 2*p;
+		a2 = -p*p;
+		lastLP = lastHP = -1.0f;
+	}
+
+	// the exp() only runs when a frequency actually moved
+	const Coefs& tune(float LPHz, float HPHz)
+	{
+		if(LPHz != lastLP)
+		{
+			coefs.lpB1 = pole(LPHz);
+			coefs.lpA0 = 1 - coefs.lpB1;
+			lastLP = LPHz;
+		}
+		if(HPHz != lastHP)
+		{
+			coefs.hpB1 = pole(HPHz);
+			coefs.hpA0 = 1 - coefs.hpB1;
+			lastHP = HPHz;
+		}
+		return coefs;
+	}
+
+	static T pre(Lane& s, const Coefs& k, T sample)
+	{
+		s.lp = sample * k.lpA0 + s.lp * k.lpB1;
+		s.hp = s.lp * k.hpA0 + s.hp * k.hpB1;
+		return s.lp - s.hp;
+	}
+
+	T post(Lane& s, T sample) const
+	{
+		const T x = g * sample;
+		const T y = x + s.z1;
+		s.z1 = s.z2 - 2*x + a1*y;
+		s.z2 = x + a2*y;
+		return y;
+	}
+
+private:
+
+	T pole(float fHz) const { return std::exp(-consts<T>::tau * fHz / sr); }
+
+	Coefs coefs;
+	float lastLP = -1.0f, lastHP = -1.0f;
+	float sr = 44100.0f;
+	T g = 0, a1 = 0, a2 = 0;
+};
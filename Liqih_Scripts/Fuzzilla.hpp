@@ -19,6 +19,13 @@
 
 #include <effect.h>
 #include <consts.h>
+#include "SubBlock.hpp"
+#include "FilterChain.hpp"
+#include "WorkerPool.hpp"
+#include "WaveshaperTable.hpp"
+#include "Snapshot.hpp"
+#include "Limiter.hpp"
+#include "Arena.hpp"
 
 using namespace ape;
 
@@ -39,118 +46,193 @@ public:
 	Param<bool>     halfThru{ "halfThru" };
 	Param<float>    gain{  "gain" ,  Range(0, 1) };
 	Param<float>    wet{   "dry/wet", Range(0, 1) };
+	Param<bool>     limit{ "limit" }; // true-peak lookahead limiter on the output
+	Param<float>    ceiling{ "ceiling", "dBTP", Range(-12, 0) };
+	Param<bool>     parallel{ "parallel" }; // spread wide buses over worker threads, taken at start()
+	Param<float>    morph{ "morph", Range(0, 1) }; // scene A -> scene B
+	Param<bool>     storeA{ "storeA" };
+	Param<bool>     storeB{ "storeB" };
+	Param<bool>     recallA{ "recallA" }; // scene A with its filter state
+	Param<bool>     recallB{ "recallB" };
+
+	MeteredValue    latency = MeteredValue("latency (smp)"); // of the limiter, see TruePeakLimiter::latency()
+	MeteredValue    footprint = MeteredValue("memory (bytes)"); // object and hot arena, set in start()
 
 	Fuzzilla() {}
 
 private:
 
-	class P1Filter
-	{
-	public:
-		P1Filter() { state = 0; }
+	// sample type of the filter chain and the shaper curve
+	using Real = float;
 
-		void flush() { state = 0; }		
+	// parallel and the scene controls stay out
+	auto preset() { return std::tie(HPHz, LPHz, threshold, bias, crack, rect, reso, soft, halfThru, gain, wet, limit, ceiling); }
+	using Preset = Snapshot<13>;
 
-		void setFreq(float fHz, float sr)
-		{
-			if(sr < 22050.0f) sr = 22050.0f;
-			b1 = std::exp(-consts<float>::tau * fHz / sr);
-			a0 = 1 - b1;
-		}	
-		float filterLP(float sample)
-		{
-			state = sample * a0 + state * b1;
-			return	state;
-		}
-		float filterHP(float sample)
-		{
-			state = sample * a0 + state * b1;
-			return	sample - state;
-		}
+	// starting preset
+	static constexpr Preset factory {{ 37.0f, 4400.0f, 0.05f, 0.1f, 0.05f, 1.0f, 0.1f, 0.5f, 0.0f, 0.86f, 0.5f, 0.0f, -1.0f }};
+
+	using Chain = FilterChain<Real>;
 
-	private:
-		float state;
-		float a0, b1;	
+	// control values, picked up once per sub-block
+	struct Control
+	{
+		Real vol, wet, bias, crack, rect, threshold, reso, soft;
+		Real tanhThreshold; // the threshold's share of the curve, see fuzzCurve()
+		Chain::Coefs filters;
 	};
 
-	std::vector<P1Filter>  HPfilter;
-	std::vector<P1Filter>  LPfilter;
-	std::vector<P1Filter>  DCfilter1;
-	std::vector<P1Filter>  DCfilter2;
-	std::vector<float>    buffers;
+	// my custom waveshaper, only ever fed x > 0, without its threshold:
+	// tanh(p - t) = (tanh p - tanh t) / (1 - tanh p tanh t) puts that back exactly
+	static Real fuzzCurve(Real x)
+	{
+		const Real x2 = x*x;
+		const Real x4 = x2*x2;
+		return std::tanh(Real(-200)*x4*x+Real(440)*x4-Real(269)*x*x2+Real(55)*x2-Real(0.5)*x);
+	}
+
+	Chain chain;
+	WaveshaperTable<Real> shaper; // fuzzCurve over x in [0, 2]
+	Arena hot; // the three tables below, one allocation
+	Chain::Lane* lanes = nullptr; // LP, HP and DC states per channel
+	Real* buffers = nullptr;      // resonance feedback per channel
+	Control* controls = nullptr;
+	Control held {};
+	SubBlock clock;
+	WorkerPool pool;
+	Scenes<Preset::COUNT> scenes;
+	std::vector<TruePeakLimiter<Real>> limiters;
+	Real limitCeiling = 1;
+	bool limiting = false;
+	std::size_t channels = 0; // lanes built in start()
 
 	void start(const IOConfig& cfg) override
 	{ 
-		// starting preset
-		HPHz = 37.0f;
-		LPHz = 4400.0f;
-		threshold = 0.05f;			
-		bias = 0.1f;
-		crack = 0.05f;
-		rect = 1.0f;
-		reso = 0.1f;
-		soft = 0.5f;
-		gain = 0.86f;
-		wet = 0.5f;
-
-		HPfilter.resize(cfg.inputs);
-		LPfilter.resize(cfg.inputs);
-		DCfilter1.resize(cfg.inputs);
-		DCfilter2.resize(cfg.inputs);
-		buffers.resize(cfg.inputs);
+		std::apply([](auto&... p) { factory.recall(p...); }, preset());
+
+		hot.build([&](Arena& a)
+		{
+			lanes = a.take<Chain::Lane>(cfg.inputs);
+			buffers = a.take<Real>(cfg.inputs);
+			controls = a.take<Control>(SubBlock::maxSpans(cfg.maxBlockSize));
+		});
+		footprint = float(sizeof(*this) + hot.size());
+		clock.reset();
+		pool.start(parallel ? WorkerPool::suggested(cfg.inputs) : 0, 1.5 * cfg.maxBlockSize / cfg.sampleRate);
+		chain.setSampleRate(cfg.sampleRate);
+		shaper.start(fuzzCurve, Real(2)); // past x = 2 the curve sits at -1
+
+		limiters.resize(cfg.inputs);
+		for (auto& l : limiters)
+			l.start(cfg.sampleRate);
+		limiting = false;
+
+		channels = cfg.inputs;
+		std::apply([&](auto&... p) { scenes.reset(morph, [this](auto&& keep) { state(keep); }, p...); }, preset());
 	}
 
-	void process(umatrix<const float> inputs, umatrix<float> outputs, size_t frames) override
+	// filter and resonance memories; the limiters' lookahead is delay memory and stays
+	template<typename F>
+	void state(F&& keep)
 	{
-		const auto shared = sharedChannels();
-		const float parVol = gain*gain*10.0f;
-		const float parWet = wet;
-		const float parbias = -bias;
-		const float parcrack = 1.0f-crack;
-		const float parrect = rect*0.5f+0.5f;
-		const float parthreshold = 0.4f * threshold;
-		const float parLPHz = LPHz;
-		const float parHPHz = HPHz;
-		const float parreso = reso*0.98f;
-		const float parsoft = soft*0.98f;
-
-		for (std::size_t c = 0; c < shared; ++c)
+		for (std::size_t c = 0; c < channels; ++c)
 		{
-			const float sr = config().sampleRate;
-			HPfilter[c].setFreq(parHPHz, sr);
-			LPfilter[c].setFreq(parLPHz, sr);
-			DCfilter1[c].setFreq(40.0f, sr);
-			DCfilter2[c].setFreq(40.0f, sr);
+			keep(lanes[c]);
+			keep(buffers[c]);
 		}
+	}
+
+	void process(umatrix<const float> inputs, umatrix<float> outputs, size_t frames) override
+	{
+		const auto shared = sharedChannels();
+
+		std::apply([&](auto&... p) { scenes.update(storeA, storeB, recallA, recallB, morph, [this](auto&& keep) { state(keep); }, p...); }, preset());
 
-		for (std::size_t c = 0; c < shared; ++c)
+		// control rate: one set of values per sub-block
+		std::size_t spans = 0;
+		clock.forEach(frames, [&](std::size_t n, std::size_t, bool boundary)
 		{
-			for (std::size_t n = 0; n < frames; ++n)
+			if(boundary)
 			{
-				const float inS = inputs[c][n] - buffers[c]*parreso; // - feedback
-				const float inF = HPfilter[c].filterHP(LPfilter[c].filterLP(std::clamp(inS, -1.0f, 1.0f)));
-				const float inR = inF*(1.0f-parrect) + std::fabs(inF)*parrect; // blend
-
-				float out = 0.0f;
-
-				const float x = inR;
-				if(x > 0.0f) // my custom waveshaper
-				{
-					const float x2 = x*x;
-					const float x4 = x2*x2;
-					out = std::tanh(-200.0f*x4*x+440.0f*x4-269.0f*x*x2+55.0f*x2-0.5f*x-parthreshold); 					
-					out = out*(1.0f-parsoft)+(x-parthreshold)*parsoft;	// blend							
-					if(out < 0.0f) halfThru? out = inS : out = 0.0f; 
-				}
-
-				buffers[c] = inR;
-
-				const float inD = inR*parcrack + (1.0f-parcrack); // nasty
-				outputs[c][n] = DCfilter2[c].filterHP(DCfilter1[c].filterHP( 
-					std::tanh( inD*(out+parbias)*parVol*parWet+(1.0f-parWet)*inS ))); // maybe tanh is not needed here
+				const float g = gain[n];
+				held.vol = g*g*10.0f;
+				held.wet = wet[n];
+				held.bias = -bias[n];
+				held.crack = 1.0f-crack[n];
+				held.rect = rect[n]*0.5f+0.5f;
+				held.threshold = 0.4f * threshold[n];
+				held.tanhThreshold = std::tanh(held.threshold);
+				held.reso = reso[n]*0.98f;
+				held.soft = soft[n]*0.98f;
+				held.filters = chain.tune(LPHz[n], HPHz[n]);
 			}
-		} 
+			controls[spans++] = held;
+		});
+
+		const bool parlimit = limit;
+		if(parlimit && !limiting)
+			for (auto& l : limiters)
+				l.reset();
+		limiting = parlimit;
+		limitCeiling = Real(dB::from(float(ceiling)));
+		latency = limiting && !limiters.empty() ? float(limiters[0].latency()) : 0.0f;
+
+		// halfThru holds for the whole block
+		const auto kernel = halfThru ? &Fuzzilla::processChannel<true> : &Fuzzilla::processChannel<false>;
+
+		// channels are independent, so wide buses can be cut into groups
+		const std::size_t groups = parallel && WorkerPool::worth(frames, shared) ? std::min(shared, pool.size() + 1) : 1;
+		auto group = [&](std::size_t g)
+		{
+			for (std::size_t c = g * shared / groups; c < (g + 1) * shared / groups; ++c)
+				(this->*kernel)(c, inputs, outputs, frames);
+		};
+		pool.parallelFor(groups, group);
 
+		clock.advance(frames);
 		clear(outputs, shared);
 	}
+
+	template<bool HalfThru>
+	void processChannel(std::size_t c, umatrix<const float>& inputs, umatrix<float>& outputs, size_t frames)
+	{
+		Chain::Lane& lane = lanes[c];
+		Real feedback = buffers[c];
+		Real inS[SubBlock::SIZE], inR[SubBlock::SIZE], shaped[SubBlock::SIZE];
+		std::size_t s = 0;
+
+		clock.forEach(frames, [&](std::size_t offset, std::size_t count, bool)
+		{
+			const Control& ctl = controls[s++];
+
+			// recursive part: input filters and the resonance feedback
+			for (std::size_t n = 0; n < count; ++n)
+			{
+				inS[n] = inputs[c][offset + n] - feedback*ctl.reso; // - feedback
+				const Real inF = Chain::pre(lane, ctl.filters, std::clamp(inS[n], Real(-1), Real(1)));
+				inR[n] = feedback = inF*(1-ctl.rect) + std::fabs(inF)*ctl.rect; // blend
+			}
+
+			// memoryless part: no sample depends on another, so no branches either
+			for (std::size_t n = 0; n < count; ++n)
+			{
+				const Real x = inR[n];
+				const Real t = shaper.cubic(x);
+				const Real curve = (t - ctl.tanhThreshold) / (1 - t*ctl.tanhThreshold);
+				const Real blend = curve*(1-ctl.soft)+(x-ctl.threshold)*ctl.soft;
+				const Real out = !(x > 0) ? 0 : blend >= 0 ? blend : HalfThru ? inS[n] : 0;
+
+				const Real inD = x*ctl.crack + (1-ctl.crack); // nasty
+				shaped[n] = std::tanh( inD*(out+ctl.bias)*ctl.vol*ctl.wet+(1-ctl.wet)*inS[n] ); // maybe tanh is not needed here
+			}
+
+			for (std::size_t n = 0; n < count; ++n)
+				outputs[c][offset + n] = float(chain.post(lane, shaped[n]));
+		});
+
+		buffers[c] = feedback;
+
+		if(limiting)
+			limiters[c].process(outputs[c], frames, limitCeiling);
+	}
 };
\ No newline at end of file
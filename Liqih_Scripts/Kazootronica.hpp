@@ -1,5 +1,10 @@
 #include <effect.h>
 #include <consts.h>
+#include "SubBlock.hpp"
+#include "Snapshot.hpp"
+#include "PitchTracker.hpp"
+#include "Limiter.hpp"
+#include "Arena.hpp"
 
 using namespace ape;
 
@@ -18,11 +23,42 @@ public:
 	Param<float>    rect{  "rect",  Range(0, 1) };
 	Param<float>   gain{   "gain" , Range(0, 1) };
 	Param<float>    wet{   "dry/wet", Range(0, 1) };
+	Param<float>    buzz{  "buzz",  Range(0, 1) }; // membrane buzz following the tracked pitch
+	Param<float>    vocal{ "vocal", Range(0, 1) }; // through the formant bank
+	Param<float>    formant{ "formant", Range(0.5, 2, Range::Exp) };
+	Param<bool>     quantise{ "quantise" };
+	Param<bool>     limit{ "limit" }; // true-peak lookahead limiter on the output
+	Param<float>    ceiling{ "ceiling", "dBTP", Range(-12, 0) };
+	Param<float>    morph{ "morph", Range(0, 1) }; // scene A -> scene B
+	Param<bool>     storeA{ "storeA" };
+	Param<bool>     storeB{ "storeB" };
+	Param<bool>     recallA{ "recallA" }; // scene A with its voice and glide state
+	Param<bool>     recallB{ "recallB" };
+
+	MeteredValue    latency = MeteredValue("latency (smp)"); // limiter delay, compensate by hand
+	MeteredValue    footprint = MeteredValue("memory (bytes)"); // object and hot arena, set in start()
 
 	Kazootronica() {}
 
 private:
 
+	// sample type of the voices: glide, resonators and tube filters
+	using Real = float;
+
+	// everything but the scene controls
+	auto preset() { return std::tie(LPHz, gate0, bias, harsh, rect, gain, wet, buzz, vocal, formant, quantise, limit, ceiling); }
+	using Preset = Snapshot<13>;
+
+	// starting preset
+	static constexpr Preset factory {{ 1200.0f, 0.05f, 0.0f, 0.05f, 1.0f, 0.86f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, -1.0f }};
+
+	// kazoo tube resonances, before the formant shift
+	enum { FORMANTS = 4 };
+	static constexpr float formantHz[FORMANTS] { 520.0f, 1190.0f, 2390.0f, 3400.0f };
+	static constexpr float formantBW[FORMANTS] { 60.0f, 90.0f, 150.0f, 200.0f };
+	static constexpr float formantLevel[FORMANTS] { 1.0f, 0.7f, 0.45f, 0.3f };
+
+	template<typename T>
 	class P1Filter
 	{
 	public:
@@ -33,91 +69,290 @@ private:
 		void setFreq(float fHz, float sr)
 		{
 			if(sr < 22050.0f) sr = 22050.0f;
-			b1 = std::exp(-consts<float>::tau * fHz / sr);
+			b1 = std::exp(-consts<T>::tau * fHz / sr);
 			a0 = 1 - b1;
 		}	
-		float filterLP(float sample)
+		T filterLP(T sample)
 		{
 			state = sample * a0 + state * b1;
 			return	state;
 		}
-		float filterHP(float sample)
+		T filterHP(T sample)
 		{
 			state = sample * a0 + state * b1;
 			return	sample - state;
 		}
 
 	private:
-		float state;
-		float a0, b1;	
+		T state;
+		T a0, b1;	
 	};
 
-	std::vector<P1Filter>  HPfilter;
-	std::vector<P1Filter>  LPfilter;
-	std::vector<P1Filter>  DCfilter1;
-	std::vector<P1Filter>  DCfilter2;
-	std::vector<float>    buffers;
+	// two-pole resonators, one SIMD lane per formant
+	struct Formants
+	{
+		Real g[FORMANTS], a1[FORMANTS], a2[FORMANTS];
+	};
+
+	// everything a channel carries from one sample to the next
+	struct alignas(64) Voice
+	{
+		Real feedback = 0, env = 0, phase = 0;
+		Real y1[FORMANTS] {}, y2[FORMANTS] {};
+		P1Filter<Real> HPfilter, LPfilter, DCfilter1, DCfilter2;
+	};
+
+	// control values, picked up once per sub-block
+	struct Control
+	{
+		Real vol, wet, bias, harsh, rect, gate0;
+		Real buzz, vocal, dt, voicing;
+		float LPHz;
+		Formants formants;
+	};
+
+	void tuneFormants(float shift, float sr)
+	{
+		for (int k = 0; k < FORMANTS; ++k)
+		{
+			const float hz = std::min(formantHz[k] * shift, 0.45f * sr);
+			const Real r = std::exp(-consts<Real>::pi * formantBW[k] * shift / sr);
+			const Real cos2 = std::cos(2 * consts<Real>::tau * hz / sr);
+			tuned.a1[k] = 2 * r * std::cos(consts<Real>::tau * hz / sr);
+			tuned.a2[k] = r * r;
+			tuned.g[k] = (1 - r) * std::sqrt(1 - 2 * r * cos2 + r * r) * formantLevel[k]; // ~unity peak
+		}
+		tunedShift = shift;
+	}
+
+	// band-limited step correction for the buzz sawtooth
+	static Real polyBlep(Real t, Real dt)
+	{
+		if(t < dt) { t /= dt; return t + t - t * t - 1; }
+		if(t > 1 - dt) { t = (t - 1) / dt; return t * t + t + t + 1; }
+		return 0;
+	}
+
+	Arena hot; // voices and the control table, one allocation
+	Voice* voices = nullptr;
+	Control* controls = nullptr;
+	P1Filter<Real>  trackFilter; // keeps the tracker's decimation clean
+	PitchTracker    tracker;
+	Formants tuned {};
+	float tunedShift = 0.0f;
+	Real attack = 0, release = 0;
+	Real glide = 0;
+	static constexpr Real levels[4] { 0, Real(0.4), Real(0.8), 1 };
+	Control held {};
+	SubBlock clock;
+	Scenes<Preset::COUNT> scenes;
+	std::vector<TruePeakLimiter<Real>> limiters;
+	Real limitCeiling = 1;
+	bool limiting = false;
+	std::size_t channels = 0; // voices built in start()
 
 	void start(const IOConfig& cfg) override
 	{ 
-		LPHz = 1200.0f;
-		gate0 = 0.05f;	
-		gain = 0.86f;
-		bias = 0.0f;
-		harsh = 0.05;
-		rect = 1.0f;
-		wet = 1.0f;
-
-		HPfilter.resize(cfg.inputs);
-		LPfilter.resize(cfg.inputs);
-		DCfilter1.resize(cfg.inputs);
-		DCfilter2.resize(cfg.inputs);
-		buffers.resize(cfg.inputs);
+		std::apply([](auto&... p) { factory.recall(p...); }, preset());
+
+		hot.build([&](Arena& a)
+		{
+			voices = a.take<Voice>(cfg.inputs);
+			controls = a.take<Control>(SubBlock::maxSpans(cfg.maxBlockSize));
+		});
+		footprint = float(sizeof(*this) + hot.size());
+		clock.reset();
+
+		const float sr = cfg.sampleRate;
+		for (std::size_t c = 0; c < cfg.inputs; ++c)
+		{
+			voices[c].HPfilter.setFreq(82.0f, sr);
+			voices[c].DCfilter1.setFreq(40.0f, sr);
+			voices[c].DCfilter2.setFreq(40.0f, sr);
+		}
+
+		trackFilter.flush();
+		trackFilter.setFreq(1000.0f, sr);
+		tracker.start(sr);
+		tuneFormants(formant, sr);
+		attack = 1 - std::exp(Real(-1) / (Real(0.005) * sr));
+		release = 1 - std::exp(Real(-1) / (Real(0.08) * sr));
+		glide = 0;
+
+		limiters.resize(cfg.inputs);
+		for (auto& l : limiters)
+			l.start(sr);
+		limiting = false;
+
+		channels = cfg.inputs;
+		std::apply([&](auto&... p) { scenes.reset(morph, [this](auto&& keep) { state(keep); }, p...); }, preset());
+	}
+
+	// voices, pitch glide and the tracker's input filter; the tracker's own
+	// analysis window is signal history and stays as it is
+	template<typename F>
+	void state(F&& keep)
+	{
+		for (std::size_t c = 0; c < channels; ++c)
+			keep(voices[c]);
+		keep(glide);
+		keep(trackFilter);
+	}
+
+	// Channels = 0 is the generic bus, mono and stereo get unrolled sums
+	template<std::size_t Channels>
+	void trackPitch(umatrix<const float>& inputs, std::size_t shared, std::size_t offset, std::size_t frames)
+	{
+		const std::size_t count = Channels ? Channels : shared;
+		if(count == 0)
+			return;
+
+		const Real scale = Real(1) / count;
+		for (std::size_t n = offset; n < offset + frames; ++n)
+		{
+			Real mid = 0;
+			for (std::size_t c = 0; c < count; ++c)
+				mid += inputs[c][n];
+			tracker.push(float(trackFilter.filterLP(mid * scale)));
+		}
 	}
 
 	void process(umatrix<const float> inputs, umatrix<float> outputs, size_t frames) override
 	{
 		const auto shared = sharedChannels();
-		const float parVol = gain*gain*10.0f;
-		const float parWet = wet;
-		const float parbias = -bias;
-		const float parharsh = 1.0f-harsh;
-		const float parrect = rect*0.5f+0.5f;
-		const float pargate0 = gate0*0.999f+0.001f;
-		const float parLPHz = LPHz;
-		
-		for (std::size_t c = 0; c < shared; ++c)
+
+		std::apply([&](auto&... p) { scenes.update(storeA, storeB, recallA, recallB, morph, [this](auto&& keep) { state(keep); }, p...); }, preset());
+		const float sr = config().sampleRate;
+		const bool parquantise = quantise;
+
+		// the pitch is tracked once, on the channel average, and fed span by
+		// span so what a sub-block sees does not depend on the block size;
+		// only the buzz uses it, so it rests while that is off
+		const auto track = shared == 1 ? &Kazootronica::trackPitch<1>
+			: shared == 2 ? &Kazootronica::trackPitch<2> : &Kazootronica::trackPitch<0>;
+
+		// control rate: one set of values per sub-block
+		std::size_t spans = 0;
+		bool buzzed = false, voiced = false;
+		clock.forEach(frames, [&](std::size_t n, std::size_t count, bool boundary)
 		{
-        	const float sr = config().sampleRate;
-			HPfilter[c].setFreq(82.0f, sr);
-			LPfilter[c].setFreq(parLPHz, sr);
-			DCfilter1[c].setFreq(40.0f, sr);
-			DCfilter2[c].setFreq(40.0f, sr);
-		}
+			if(boundary)
+			{
+				const float g = gain[n];
+				held.vol = g*g*10.0f;
+				held.wet = wet[n];
+				held.bias = -bias[n];
+				held.harsh = 1.0f-harsh[n];
+				held.rect = rect[n]*0.5f+0.5f;
+				held.gate0 = gate0[n]*0.999f+0.001f;
+				held.LPHz = LPHz[n];
+				held.buzz = buzz[n];
+				held.vocal = vocal[n];
+
+				const float shift = formant[n];
+				if(shift != tunedShift) tuneFormants(shift, sr);
+				held.formants = tuned;
+
+				const Real target = tracker.frequency() / sr;
+				glide += (target - glide) * Real(0.25); // pitch glide, ~3 ms at 44.1 kHz
+				held.dt = glide;
+				held.voicing = std::clamp((tracker.confidence() - Real(0.6)) / Real(0.3), Real(0), Real(1));
+			}
+			controls[spans++] = held;
+			buzzed |= held.buzz > 0;
+			voiced |= held.vocal > 0;
+			if(held.buzz > 0)
+				(this->*track)(inputs, shared, n, count);
+		});
 
+		const bool parlimit = limit;
+		if(parlimit && !limiting)
+			for (auto& l : limiters)
+				l.reset();
+		limiting = parlimit;
+		limitCeiling = Real(dB::from(float(ceiling)));
+		latency = limiting && !limiters.empty() ? float(limiters[0].latency()) : 0.0f;
+
+		// quantiser, buzz and formant bank each drop out of the loop when off
+		using Kernel = void (Kazootronica::*)(std::size_t, umatrix<const float>&, umatrix<float>&, size_t);
+		static constexpr Kernel kernels[8] {
+			&Kazootronica::processChannel<false, false, false>, &Kazootronica::processChannel<true, false, false>,
+			&Kazootronica::processChannel<false, true, false>,  &Kazootronica::processChannel<true, true, false>,
+			&Kazootronica::processChannel<false, false, true>,  &Kazootronica::processChannel<true, false, true>,
+			&Kazootronica::processChannel<false, true, true>,   &Kazootronica::processChannel<true, true, true>
+		};
+		const auto kernel = kernels[parquantise + 2 * buzzed + 4 * voiced];
 		for (std::size_t c = 0; c < shared; ++c)
+			(this->*kernel)(c, inputs, outputs, frames);
+		clock.advance(frames);
+		clear(outputs, shared);
+	}
+
+	template<bool Quantise, bool Buzz, bool Vocal>
+	void processChannel(std::size_t c, umatrix<const float>& inputs, umatrix<float>& outputs, size_t frames)
+	{
+		const float sr = config().sampleRate;
+		Voice& v = voices[c];
+		std::size_t s = 0;
+
+		clock.forEach(frames, [&](std::size_t offset, std::size_t count, bool boundary)
 		{
-			for (std::size_t n = 0; n < frames; ++n)
+			const Control& ctl = controls[s++];
+
+			if(boundary)
+				v.LPfilter.setFreq(ctl.LPHz, sr);
+
+			const Formants& fm = ctl.formants;
+
+			// spans with a stage at 0 skip it too, so its state only moves while it
+			// is heard and the output does not depend on how spans group into blocks
+			const bool buzzing = Buzz && ctl.buzz > 0;
+			const bool singing = Vocal && ctl.vocal > 0;
+
+			for (std::size_t n = offset; n < offset + count; ++n)
 			{
-				const float inS = inputs[c][n] + buffers[c]*0.1f;
-				const float inF = HPfilter[c].filterHP(LPfilter[c].filterLP(std::clamp(inS, -1.0f, 1.0f)));
-				const float inR = inF*(1.0f-parrect) + std::fabs(inF)*parrect;
-
-				float out = 0.0f;
-				if(inR  > 0.8f ) out = 1.0f;
-				else if (inR <= 0.8f && inR > 0.4f) out = 0.8f;
-				else if (inR <= 0.4f && inR > pargate0) out = 0.4f;
+				const Real inS = inputs[c][n] + v.feedback*Real(0.1);
+				const Real inF = v.HPfilter.filterHP(v.LPfilter.filterLP(std::clamp(inS, Real(-1), Real(1))));
+				const Real inR = inF*(1-ctl.rect) + std::fabs(inF)*ctl.rect;
+
+				// optional three-level quantiser as a table pick, gate0 always stays below 0.4
+				const Real stage = Quantise ? levels[(inR > ctl.gate0) + (inR > Real(0.4)) + (inR > Real(0.8))] : inR;
 				
-				buffers[c] = inR;
+				v.feedback = inR;
+
+				// the membrane buzzes at the sung pitch, as loud as the voice
+				Real excite = stage;
+				if(buzzing)
+				{
+					const Real level = std::fabs(inF);
+					v.env += (level - v.env) * (level > v.env ? attack : release);
+					v.phase += ctl.dt;
+					v.phase -= (int)v.phase;
+					const Real saw = 2*v.phase - 1 - polyBlep(v.phase, ctl.dt);
+					excite = stage*(1-ctl.buzz) + saw*std::min(v.env*4, Real(1))*ctl.voicing*ctl.buzz;
+				}
+
+				Real out = stage;
+				if(singing)
+				{
+					Real voiced = 0;
+					for (int k = 0; k < FORMANTS; ++k)
+					{
+						const Real y = fm.g[k]*excite + fm.a1[k]*v.y1[k] - fm.a2[k]*v.y2[k];
+						v.y2[k] = v.y1[k];
+						v.y1[k] = y;
+						voiced += y;
+					}
+					out = stage*(1-ctl.vocal) + voiced*ctl.vocal;
+				}
 				
-				const float inD = inR*parharsh + (1.0f-parharsh);
-				outputs[c][n] = DCfilter2[c].filterHP(DCfilter1[c].filterHP(
-				std::tanh( inD*(out+parbias)*parVol*parWet+(1.0f-parWet)*inS )));
+				const Real inD = inR*ctl.harsh + (1-ctl.harsh);
+				outputs[c][n] = float(v.DCfilter2.filterHP(v.DCfilter1.filterHP(
+				std::tanh( inD*(out+ctl.bias)*ctl.vol*ctl.wet+(1-ctl.wet)*inS ))));
 			}
-		} 
+		});
 
-		clear(outputs, shared);
+		if(limiting)
+			limiters[c].process(outputs[c], frames, limitCeiling);
 	}
-
-
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+//
+//  Limiter.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <consts.h>
+
+using namespace ape;
+
+// True-peak lookahead limiter for one channel.
+// Peaks are estimated on a 4x polyphase upsampling of the signal, the
+// largest one ahead of the audio is tracked with a monotonic deque, and
+// the resulting gain is box-smoothed over the lookahead so it is already
+// down when the peak comes out of the delay. Allocates in start() only.
+template<typename T = float>
+class TruePeakLimiter
+{
+public:
+
+	enum { OVERSAMPLE = 4, TAPS = 12 }; // 48 taps in all, as in ITU-R BS.1770
+
+	void start(float sampleRate, float lookaheadMs = 1.5f, float releaseMs = 60.0f)
+	{
+		window = std::max(8, int(lookaheadMs * 0.001f * sampleRate));
+		release = T(1) - std::exp(T(-1) / (T(releaseMs) * T(0.001) * sampleRate));
+
+		// windowed sinc, phase p interpolates p/4 past the centre tap
+		for (int p = 0; p < OVERSAMPLE; ++p)
+		{
+			T norm = 0;
+			for (int k = 0; k < TAPS; ++k)
+			{
+				const T u = T(TAPS / 2 - 1) + T(p) / OVERSAMPLE - k;
+				const T sinc = u == 0 ? T(1) : std::sin(consts<T>::pi * u) / (consts<T>::pi * u);
+				const T w = T(0.42) + T(0.5) * std::cos(consts<T>::pi * u / (TAPS / 2)) + T(0.08) * std::cos(consts<T>::tau * u / (TAPS / 2));
+				norm += kernel[p][k] = sinc * w;
+			}
+			for (int k = 0; k < TAPS; ++k)
+				kernel[p][k] /= norm;
+		}
+
+		delay.assign(latency(), T(0));
+		gains.assign(window, T(1));
+		deque.assign(window, Peak());
+		reset();
+	}
+
+	// also before switching back in, or the delay line replays audio from last time
+	void reset()
+	{
+		std::fill(history, history + 2 * TAPS, T(0));
+		std::fill(delay.begin(), delay.end(), T(0));
+		std::fill(gains.begin(), gains.end(), T(1));
+		sum = window;
+		env = 1;
+		tap = slot = head = 0;
+		front = back = 0;
+		now = 0;
+	}
+
+	// samples between a sample going in and coming out; APE cannot report
+	// latency to the host, so patches put this on a meter for manual compensation
+	std::size_t latency() const { return window + TAPS / 2 - 1; }
+
+	void process(float* io, std::size_t frames, T ceiling)
+	{
+		const std::size_t size = delay.size();
+		const std::size_t queue = deque.size();
+
+		for (std::size_t n = 0; n < frames; ++n)
+		{
+			const T x = io[n];
+
+			// the last TAPS inputs, twice over so they always read contiguously
+			history[tap] = history[tap + TAPS] = x;
+			if(++tap == TAPS) tap = 0;
+			const T* h = history + tap;
+
+			T peak = 0;
+			for (int p = 0; p < OVERSAMPLE; ++p)
+			{
+				T y = 0;
+				for (int k = 0; k < TAPS; ++k)
+					y += kernel[p][k] * h[k];
+				peak = std::max(peak, std::fabs(y));
+			}
+
+			// sliding maximum: forget what fell out of the window and everything the new peak beats
+			if(back != front && deque[front % queue].at + window <= now)
+				++front;
+			while(back != front && deque[(back + queue - 1) % queue].value <= peak)
+				--back;
+			deque[back++ % queue] = { now, peak };
+
+			const T top = deque[front % queue].value;
+			const T target = top > ceiling ? ceiling / top : T(1);
+
+			// box average over the window, then instant attack and a slow release
+			sum += target - gains[slot];
+			gains[slot] = target;
+			if(++slot == (std::size_t)window) slot = 0;
+			const T smooth = T(sum / window);
+			env = smooth < env ? smooth : env + (smooth - env) * release;
+
+			const T out = delay[head];
+			delay[head] = x;
+			if(++head == size) head = 0;
+
+			io[n] = float(out * env);
+			++now;
+		}
+	}
+
+private:
+
+	struct Peak
+	{
+		uint64_t at;
+		T value;
+	};
+
+	T kernel[OVERSAMPLE][TAPS] {};
+	T history[2 * TAPS] {};
+	std::vector<T> delay;
+	std::vector<T> gains;
+	std::vector<Peak> deque;
+	double sum = 0;
+	T env = 1, release = 0;
+	int window = 8;
+	std::size_t tap = 0, slot = 0, head = 0;
+	uint64_t front = 0, back = 0, now = 0;
+};
\ No newline at end of file
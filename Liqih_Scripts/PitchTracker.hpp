@@ -0,0 +1,143 @@
+//
+//  PitchTracker.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// YIN pitch tracker running on a 4x decimated signal.
+// Every HOP decimated samples the latest window is frozen, and its
+// difference function is then worked out a few lags at a time while the
+// next HOP samples arrive, so the cost per input sample stays flat.
+class PitchTracker
+{
+public:
+
+	enum { DECIMATION = 4, HOP = 64 };
+
+	void start(float sampleRate, float minHz = 70.0f, float maxHz = 900.0f)
+	{
+		rate = sampleRate / DECIMATION;
+		minLag = std::max(2, int(rate / maxHz));
+		maxLag = int(std::ceil(rate / minHz));
+		length = 2 * maxLag; // window of maxLag, plus the largest shift
+		perStep = (maxLag + HOP - 1) / HOP;
+
+		history.assign(length, 0.0f);
+		frame.assign(length, 0.0f);
+		diff.assign(maxLag + 1, 0.0f);
+
+		write = sub = since = 0;
+		acc = 0.0f;
+		lag = maxLag + 2; // nothing in flight and nothing left to conclude
+		hz = 0.0f;
+		clarity = 0.0f;
+	}
+
+	void push(float x)
+	{
+		acc += x;
+		if(++sub < DECIMATION)
+			return;
+
+		history[write] = acc * (1.0f / DECIMATION); // box average, the caller already low-passed
+		if(++write == length) write = 0;
+		acc = 0.0f;
+		sub = 0;
+
+		if(++since == HOP)
+		{
+			since = 0;
+			for (int i = 0; i < length; ++i) // oldest first
+				frame[i] = history[(write + i) % length];
+			lag = 1;
+		}
+
+		for (int s = 0; s < perStep && lag <= maxLag; ++s, ++lag)
+			diff[lag] = difference(lag);
+
+		if(lag == maxLag + 1)
+		{
+			conclude();
+			++lag;
+		}
+	}
+
+	// last detected fundamental in Hz, 0 before the first voiced frame
+	float frequency() const { return hz; }
+
+	// 1 for a clean periodic signal, towards 0 for noise or silence
+	float confidence() const { return clarity; }
+
+private:
+
+	float difference(int tau) const
+	{
+		float sum = 0.0f;
+		for (int j = 0; j < maxLag; ++j)
+		{
+			const float d = frame[j] - frame[j + tau];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	void conclude()
+	{
+		// cumulative mean normalised difference, in place
+		float running = 0.0f;
+		diff[0] = 1.0f;
+		for (int tau = 1; tau <= maxLag; ++tau)
+		{
+			running += diff[tau];
+			diff[tau] = running > 0.0f ? diff[tau] * tau / running : 1.0f;
+		}
+
+		int best = minLag;
+		for (int tau = minLag; tau <= maxLag; ++tau)
+		{
+			if(diff[tau] < THRESHOLD)
+			{
+				while(tau + 1 <= maxLag && diff[tau + 1] < diff[tau]) ++tau;
+				best = tau;
+				break;
+			}
+			if(diff[tau] < diff[best]) best = tau;
+		}
+
+		clarity = std::clamp(1.0f - diff[best], 0.0f, 1.0f);
+		if(diff[best] > UNVOICED)
+			return; // keep the last pitch, only the confidence drops
+
+		float shift = 0.0f;
+		if(best > minLag && best < maxLag)
+		{
+			const float a = diff[best - 1], b = diff[best], c = diff[best + 1];
+			const float den = a - 2.0f * b + c;
+			if(den > 0.0f) shift = 0.5f * (a - c) / den;
+		}
+		hz = rate / (best + shift);
+	}
+
+	static constexpr float THRESHOLD = 0.15f;
+	static constexpr float UNVOICED = 0.4f;
+
+	std::vector<float> history; // decimated input, circular
+	std::vector<float> frame;   // frozen copy being analysed
+	std::vector<float> diff;
+
+	float rate = 11025.0f;
+	int minLag = 2, maxLag = 2, length = 4, perStep = 1;
+	int write = 0, sub = 0, since = 0, lag = 4;
+	float acc = 0.0f;
+	float hz = 0.0f, clarity = 0.0f;
+};
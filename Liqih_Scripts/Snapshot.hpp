@@ -0,0 +1,209 @@
+//
+//  Snapshot.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+using namespace ape;
+
+// Fixed-size image of the Param<> values making up a preset.
+// Nothing here allocates, so capture, recall and morphing are all fine
+// on the audio thread. Serialised as: 4 byte tag, 1 byte version,
+// 1 byte count, then count little-endian IEEE floats.
+// Patches list their preset Param<>s in a preset() returning std::tie(...),
+// whose order is the snapshot order.
+template<std::size_t N>
+struct Snapshot
+{
+	enum { COUNT = N, BYTES = 6 + 4 * N, VERSION = 1 };
+
+	float values[N];
+
+	template<typename... P>
+	void capture(P&... params)
+	{
+		static_assert(sizeof...(P) == N, "one value per parameter");
+		std::size_t i = 0;
+		((values[i++] = get(params)), ...);
+	}
+
+	template<typename... P>
+	void recall(P&... params) const
+	{
+		static_assert(sizeof...(P) == N, "one value per parameter");
+		std::size_t i = 0;
+		(set(params, values[i++]), ...);
+	}
+
+	// t = 0 gives a, t = 1 gives b; the Param<> smoothing takes it from there
+	template<typename... P>
+	static void morph(const Snapshot& a, const Snapshot& b, float t, P&... params)
+	{
+		static_assert(sizeof...(P) == N, "one value per parameter");
+		std::size_t i = 0;
+		((set(params, a.values[i] + (b.values[i] - a.values[i]) * t), ++i), ...);
+	}
+
+	std::size_t write(unsigned char* out, const char (&tag)[5]) const
+	{
+		std::memcpy(out, tag, 4);
+		out[4] = VERSION;
+		out[5] = (unsigned char)N;
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &values[i], 4);
+			for (int b = 0; b < 4; ++b)
+				out[6 + 4 * i + b] = (unsigned char)(bits >> (8 * b));
+		}
+		return BYTES;
+	}
+
+	// leaves the snapshot untouched unless the image is complete and ours
+	bool read(const unsigned char* in, std::size_t size, const char (&tag)[5])
+	{
+		if(size < BYTES || std::memcmp(in, tag, 4) != 0 || in[4] != VERSION || in[5] != N)
+			return false;
+
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			uint32_t bits = 0;
+			for (int b = 0; b < 4; ++b)
+				bits |= uint32_t(in[6 + 4 * i + b]) << (8 * b);
+			std::memcpy(&values[i], &bits, 4);
+		}
+		return true;
+	}
+
+private:
+
+	template<typename T>
+	static float get(Param<T>& p)
+	{
+		if constexpr (std::is_enum<T>::value)
+			return float((int)(T)p);
+		else
+			return float((T)p);
+	}
+
+	template<typename T>
+	static void set(Param<T>& p, float v)
+	{
+		if constexpr (std::is_enum<T>::value)
+			p = static_cast<T>(std::lround(v));
+		else if constexpr (std::is_same<T, bool>::value)
+			p = v >= 0.5f;
+		else if constexpr (std::is_integral<T>::value)
+			p = static_cast<T>(std::lround(v));
+		else
+			p = static_cast<T>(v);
+	}
+};
+
+// Two scene slots and a morph control between them.
+// Storing a slot writes the Param<> values and the patch's DSP state into
+// one preallocated binary image: the Snapshot bytes, then the state
+// objects back to back. Recalling reads it back in one go, so a scene
+// comes back with its filter memories and glides where they were instead
+// of sweeping there. Morphing only blends Param<> values.
+// state(keep) calls keep(x) on every state object, in a fixed order; they
+// must be trivially copyable, and delay memory is left out.
+// Parameters are only written when a control actually moved, so hand
+// edits stick until the next store, recall or morph move.
+template<std::size_t N>
+class Scenes
+{
+public:
+
+	// from start(), once the state is built: sizes both images and fills
+	// them with the current values and the fresh state. A restart with the
+	// same layout keeps the scenes already stored
+	template<typename S, typename... P>
+	void reset(float morph, S&& state, P&... params)
+	{
+		std::size_t bytes = Snapshot<N>::BYTES;
+		state([&](auto& x) { bytes += sizeof(x); });
+
+		for (int slot = 0; slot < 2; ++slot)
+		{
+			if(images[slot].size() == bytes)
+				continue;
+			images[slot].assign(bytes, 0);
+			store(slot, state, params...);
+		}
+		lastMorph = morph;
+		lastStore[0] = lastStore[1] = lastRecall[0] = lastRecall[1] = false;
+	}
+
+	// once per block, from the audio thread
+	template<typename S, typename... P>
+	void update(bool storeA, bool storeB, bool recallA, bool recallB, float morph, S&& state, P&... params)
+	{
+		const bool stores[2] { storeA, storeB }, recalls[2] { recallA, recallB };
+		for (int slot = 0; slot < 2; ++slot)
+		{
+			if(stores[slot] && !lastStore[slot]) store(slot, state, params...);
+			if(recalls[slot] && !lastRecall[slot]) recall(slot, state, params...);
+			lastStore[slot] = stores[slot];
+			lastRecall[slot] = recalls[slot];
+		}
+
+		if(morph != lastMorph)
+		{
+			Snapshot<N>::morph(scene[0], scene[1], morph, params...);
+			lastMorph = morph;
+		}
+	}
+
+private:
+
+	static constexpr char TAG[5] = "SCNE";
+
+	template<typename S, typename... P>
+	void store(int slot, S& state, P&... params)
+	{
+		scene[slot].capture(params...);
+		unsigned char* out = images[slot].data();
+		out += scene[slot].write(out, TAG);
+		state([&](auto& x)
+		{
+			static_assert(std::is_trivially_copyable<std::decay_t<decltype(x)>>::value, "state is copied as bytes");
+			std::memcpy(out, &x, sizeof(x));
+			out += sizeof(x);
+		});
+	}
+
+	template<typename S, typename... P>
+	void recall(int slot, S& state, P&... params)
+	{
+		const unsigned char* in = images[slot].data();
+		if(!scene[slot].read(in, images[slot].size(), TAG))
+			return;
+
+		scene[slot].recall(params...);
+		in += Snapshot<N>::BYTES;
+		state([&](auto& x)
+		{
+			std::memcpy(&x, in, sizeof(x));
+			in += sizeof(x);
+		});
+	}
+
+	Snapshot<N> scene[2];
+	std::vector<unsigned char> images[2];
+	float lastMorph = 0.0f;
+	bool lastStore[2] {}, lastRecall[2] {};
+};
\ No newline at end of file
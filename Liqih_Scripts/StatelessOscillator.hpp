@@ -0,0 +1,105 @@
+//
+//  StatelessOscillator.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <cmath>
+#include <consts.h>
+
+using namespace ape;
+
+// Oscillator shapes as pure functions of a unit phase, shared by the
+// generators and by the LFOs inside the effects.
+template<typename T>
+struct StatelessOscillator
+{
+	enum class Shape
+	{
+		Sine,
+		Triangle,
+		SawDown,
+		SawUp,
+		Square,
+		Pulse,
+	};
+
+	static constexpr typename Param<Shape>::Names ShapeNames = {
+		"Sine", "Triangle", "SawDown", "SawUp", "Square", "Pulse"
+	};
+
+	static T eval(double unitPhase, Shape s)
+	{
+		T sample;
+
+		// Do range reduction to simplify oscillators
+		unitPhase = unitPhase - (long long)unitPhase;
+		// calculate the sample here, depending on the type
+		// note that all but the sine is mathematically ideal,
+		// in a way that will alias extremely much.
+		// but they are quick and demonstrates the use.
+		// see the additive synthesizer for a correct way to do this
+		switch (s)
+		{
+		case Shape::Sine: // sine
+			sample = std::cos(consts<T>::tau * unitPhase);
+			break;
+		case Shape::Triangle: // triangle
+			if (unitPhase < consts<T>::half)
+				sample = -1 + 4 * unitPhase;
+			else
+				sample = 1 - 4 * (unitPhase - consts<T>::half);
+			break;
+		case Shape::SawDown: // sawtooth
+			sample = 1 - unitPhase * 2;
+			break;
+		case Shape::SawUp: // sawtooth
+			sample = -1 + unitPhase * 2;
+			break;
+		case Shape::Square: // square
+			sample = unitPhase < consts<T>::half ? 1 : -1;
+			break;
+		case Shape::Pulse: // short positive pulse
+			sample = unitPhase < 0.01? 1 : 0;
+			break;
+		}
+
+		return sample;
+	}
+
+	// cos(tau * unitPhase) to within 1.5e-5, without a libm call:
+	// the phase is folded onto a triangle s in [-1, 1], then sin(pi/2 * s)
+	// is an odd polynomial, its last term trimmed to hit 1 exactly at the
+	// peaks. No branch either, so a loop of these vectorises.
+	static T fastSine(double unitPhase)
+	{
+		const T p = T(unitPhase - std::floor(unitPhase));
+		const T s = 4 * std::fabs(p - consts<T>::half) - 1;
+		const T s2 = s * s;
+		return s * (T(1.5707963) + s2 * (T(-0.6459641) + s2 * (T(0.0796926) + s2 * T(-0.0045248))));
+	}
+
+	// count samples starting at unitPhase, advancing by step per sample.
+	// The shape is picked once for the whole run, and Sine goes through
+	// fastSine(), so this is the one to use for LFOs computed per block.
+	static void block(double unitPhase, double step, Shape s, T* out, std::size_t count)
+	{
+		unitPhase = unitPhase - std::floor(unitPhase);
+		if(s == Shape::Sine)
+		{
+			for (std::size_t n = 0; n < count; ++n)
+				out[n] = fastSine(unitPhase + n * step);
+		}
+		else
+		{
+			for (std::size_t n = 0; n < count; ++n)
+				out[n] = eval(unitPhase + n * step, s);
+		}
+	}
+};
\ No newline at end of file
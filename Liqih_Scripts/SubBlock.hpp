@@ -0,0 +1,52 @@
+//
+//  SubBlock.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <algorithm>
+
+// Cuts the host block into spans of a fixed control-rate grid.
+// The grid runs on an absolute sample count, so control updates land
+// on the same samples whatever block size the host is using.
+template<std::size_t N>
+class SubBlockClock
+{
+public:
+
+	enum { SIZE = N };
+
+	void reset() { phase = 0; }
+
+	// calls fn(offset, count, boundary) for every span in [0, frames),
+	// boundary is true when the span starts a new sub-block
+	template<typename F>
+	void forEach(std::size_t frames, F&& fn) const
+	{
+		std::size_t p = phase;
+		for (std::size_t n = 0; n < frames; )
+		{
+			const std::size_t count = std::min(N - p, frames - n);
+			fn(n, count, p == 0);
+			n += count;
+			p = 0;
+		}
+	}
+
+	// call once per host block, after all channels used forEach()
+	void advance(std::size_t frames) { phase = (phase + frames) % N; }
+
+	// upper bound of spans in a block, for preallocating control tables
+	static std::size_t maxSpans(std::size_t maxBlockSize) { return maxBlockSize / N + 2; }
+
+private:
+	std::size_t phase = 0;
+};
+
+using SubBlock = SubBlockClock<32>;
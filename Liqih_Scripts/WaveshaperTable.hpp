@@ -0,0 +1,70 @@
+//
+//  WaveshaperTable.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <algorithm>
+#include <vector>
+
+// Transfer curve y = curve(x) sampled over [0, domain], built once in
+// start(). Anything that moves with a parameter belongs outside the table,
+// so the lookup is the same on every render whatever the block size.
+template<typename T, std::size_t SIZE = 4096>
+class WaveshaperTable
+{
+public:
+
+	using Curve = T (*)(T x);
+
+	void start(Curve curve, T domain)
+	{
+		scale = (SIZE - 1) / domain;
+		table.assign(STRIDE, T(0));
+		for (std::size_t i = 0; i < SIZE; ++i)
+			table[i + 1] = curve(T(i) / scale);
+		table[0] = table[1];
+		table[SIZE + 1] = table[SIZE + 2] = table[SIZE];
+	}
+
+	T linear(T x) const
+	{
+		std::size_t i;
+		const T f = locate(x, i);
+		const T y0 = table[i + 1], y1 = table[i + 2];
+		return y0 + (y1 - y0) * f;
+	}
+
+	// Catmull-Rom between the two nearest points
+	T cubic(T x) const
+	{
+		std::size_t i;
+		const T f = locate(x, i);
+		const T ym1 = table[i], y0 = table[i + 1], y1 = table[i + 2], y2 = table[i + 3];
+		const T c1 = T(0.5) * (y1 - ym1);
+		const T c2 = ym1 - T(2.5) * y0 + 2 * y1 - T(0.5) * y2;
+		const T c3 = T(0.5) * (y2 - ym1) + T(1.5) * (y0 - y1);
+		return ((c3 * f + c2) * f + c1) * f + y0;
+	}
+
+private:
+
+	// one guard point in front, two behind, for the cubic
+	enum { STRIDE = SIZE + 3 };
+
+	T locate(T x, std::size_t& i) const
+	{
+		const T pos = std::clamp(x * scale, T(0), T(SIZE - 1));
+		i = static_cast<std::size_t>(pos);
+		return pos - T(i);
+	}
+
+	T scale = 1;
+	std::vector<T> table;
+};
\ No newline at end of file
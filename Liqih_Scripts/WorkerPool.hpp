@@ -0,0 +1,167 @@
+//
+//  WorkerPool.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fork/join pool to spread the channels of a wide bus over cores.
+// Threads are created in start(), never on the audio thread, and
+// parallelFor() neither allocates nor locks on its fast path: idle workers
+// spin on the job counter for spinSeconds, about a block period, and only
+// then park on the condition variable, so a steady stream of blocks finds
+// them awake.
+class WorkerPool
+{
+public:
+
+	WorkerPool() {}
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool() { stop(); }
+
+	void start(std::size_t workers, double spinSeconds)
+	{
+		stop();
+		quit = false;
+		done = 0;
+		spin = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(spinSeconds));
+
+		// taken before any thread runs, so a job posted right away is never missed
+		const unsigned seen = generation.load();
+		for (std::size_t w = 0; w < workers; ++w)
+			threads.emplace_back([this, w, seen] { loop(w + 1, seen); });
+	}
+
+	void stop()
+	{
+		if(threads.empty())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+
+		for (auto& t : threads)
+			t.join();
+		threads.clear();
+	}
+
+	std::size_t size() const { return threads.size(); }
+
+	// one worker per further group of 4 channels, only for wide buses
+	static std::size_t suggested(std::size_t channels)
+	{
+		const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+		return channels < 8 ? 0 : std::min({ channels / 4 - 1, cores - 1, std::size_t(7) });
+	}
+
+	// below this many sample-frames the wake-up costs more than it saves
+	static bool worth(std::size_t frames, std::size_t channels)
+	{
+		return channels > 1 && frames * channels >= 2048;
+	}
+
+	// calls f(i) for every i in [0, count), spread over the workers and the
+	// calling thread, and returns once all of them are done
+	template<typename F>
+	void parallelFor(std::size_t count, F& f)
+	{
+		if(threads.empty() || count < 2)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				f(i);
+			return;
+		}
+
+		task = [](void* context, std::size_t i) { (*static_cast<F*>(context))(i); };
+		context = &f;
+		jobs = count;
+		done.store(0, std::memory_order_relaxed);
+		generation.fetch_add(1);
+
+		if(sleeping.load() > 0)
+		{
+			{ std::lock_guard<std::mutex> lock(mutex); }
+			wake.notify_all();
+		}
+
+		share(0);
+
+		while(done.load(std::memory_order_acquire) < threads.size())
+			std::this_thread::yield();
+	}
+
+private:
+
+	using Task = void (*)(void* context, std::size_t index);
+	using Clock = std::chrono::steady_clock;
+
+	enum { CLOCK_EVERY = 64 }; // job counter loads between looks at the clock and yields
+
+	// every thread takes indices w, w + stride, ... so no index is claimed twice
+	void share(std::size_t w)
+	{
+		const std::size_t stride = threads.size() + 1;
+		for (std::size_t i = w; i < jobs; i += stride)
+			task(context, i);
+	}
+
+	void loop(std::size_t w, unsigned seen)
+	{
+		while(true)
+		{
+			const Clock::time_point until = Clock::now() + spin;
+			for (int n = 1; generation.load(std::memory_order_acquire) == seen; ++n)
+			{
+				if(n % CLOCK_EVERY != 0)
+					continue;
+				if(Clock::now() >= until)
+					break;
+				std::this_thread::yield(); // the block's own thread may be waiting for this core
+			}
+
+			if(generation.load(std::memory_order_acquire) == seen)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				sleeping.fetch_add(1);
+				wake.wait(lock, [&] { return quit || generation.load() != seen; });
+				sleeping.fetch_sub(1);
+				if(quit)
+					return;
+			}
+
+			seen = generation.load(std::memory_order_acquire);
+			share(w);
+			done.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<unsigned> generation { 0 };
+	std::atomic<std::size_t> done { 0 };
+	std::atomic<int> sleeping { 0 };
+	bool quit = false;
+	Clock::duration spin {};
+
+	Task task = nullptr;
+	void* context = nullptr;
+	std::size_t jobs = 0;
+};
@@ -0,0 +1,200 @@
+//
+//  Host.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <effect.h>
+#include <generator.h>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Hosts one script instance on the APE stand-in: builds it, reaches its
+// controls by name and drives process() a block at a time.
+// Scripts are compiled one per translation unit, since several of them
+// define helpers of the same name; each registers itself with
+// LIQIH_PATCH(Class, "folder") and is then made by name.
+class Instance
+{
+public:
+
+	virtual ~Instance() = default;
+
+	// a generator takes no inputs; a transport effect follows head()
+	virtual bool generator() const = 0;
+	virtual ape::PlayHeadPosition* head() = 0;
+
+	virtual void start(const ape::IOConfig& cfg) = 0;
+	// in is ignored for generators
+	virtual void process(const float* const* in, std::size_t inputs, float* const* out, std::size_t outputs, std::size_t frames) = 0;
+
+	ape::host::Control* control(const std::string& name) const
+	{
+		for (auto* c : controls)
+			if(c->name == name)
+				return c;
+		return nullptr;
+	}
+
+	const float* meter(const std::string& name) const
+	{
+		for (auto& m : meters)
+			if(m.first == name)
+				return m.second;
+		return nullptr;
+	}
+
+	std::vector<ape::host::Control*> controls;
+	std::vector<std::pair<std::string, const float*>> meters;
+};
+
+struct PatchInfo
+{
+	std::string name;
+	std::function<std::unique_ptr<Instance>()> make;
+};
+
+inline std::vector<PatchInfo>& patches()
+{
+	static std::vector<PatchInfo> all;
+	return all;
+}
+
+inline std::unique_ptr<Instance> makePatch(const std::string& name)
+{
+	for (auto& p : patches())
+		if(p.name == name)
+			return p.make();
+	return nullptr;
+}
+
+template<typename P>
+class Hosted : public Instance
+{
+public:
+
+	explicit Hosted(const std::string& folder)
+	{
+		// the script's Params, meters and files find their way here while it is built
+		ape::host::controls = &controls;
+		ape::host::meters = &meters;
+		ape::host::scriptDirectory = folder;
+		try
+		{
+			patch.reset(new P());
+		}
+		catch(...)
+		{
+			ape::host::controls = nullptr;
+			ape::host::meters = nullptr;
+			throw;
+		}
+		ape::host::controls = nullptr;
+		ape::host::meters = nullptr;
+	}
+
+	bool generator() const override { return std::is_base_of<ape::Generator, P>::value; }
+
+	ape::PlayHeadPosition* head() override
+	{
+		if constexpr (std::is_base_of<ape::TransportEffect, P>::value)
+			return &patch->transport;
+		else
+			return nullptr;
+	}
+
+	void start(const ape::IOConfig& cfg) override { patch->begin(cfg); }
+
+	void process(const float* const* in, std::size_t inputs, float* const* out, std::size_t outputs, std::size_t frames) override
+	{
+		ape::umatrix<float> o(out, outputs, frames);
+		if constexpr (std::is_base_of<ape::Generator, P>::value)
+			static_cast<ape::Generator&>(*patch).process(o, frames);
+		else
+			static_cast<ape::Effect&>(*patch).process(ape::umatrix<const float>(in, inputs, frames), o, frames);
+	}
+
+private:
+
+	std::unique_ptr<P> patch;
+};
+
+#define LIQIH_PATCH(Class, folder) \
+	static const bool registered##Class = (patches().push_back({ #Class, \
+		[] { return std::unique_ptr<Instance>(new Hosted<Class>(LIQIH_SCRIPTS folder)); } }), true);
+
+// a control held at one value, or moving in a straight line from the
+// first sample of a render to its last
+struct Setting
+{
+	std::string name;
+	double from, to;
+};
+
+// one render: settings, transport and the blocks in order
+class Session
+{
+public:
+
+	// settings go in before and after start(): some scripts recall their
+	// factory preset there, others only read a control there
+	Session(Instance& instance, const ape::IOConfig& cfg, std::size_t frames, std::vector<Setting> list,
+		ape::PlayHeadPosition transport = {})
+		: patch(instance), io(cfg), total(std::max<std::size_t>(frames, 1)), settings(std::move(list)), head(transport)
+	{
+		for (auto& s : settings)
+			if(!patch.control(s.name))
+				throw std::runtime_error("no control named '" + s.name + "'");
+
+		hold();
+		patch.start(io);
+		hold();
+	}
+
+	// frames up to maxBlockSize; in holds cfg.inputs channels, out cfg.outputs
+	void block(const float* const* in, float* const* out, std::size_t frames)
+	{
+		for (auto& s : settings)
+			if(s.from != s.to && done < total)
+				patch.control(s.name)->ramp(s.from, (s.to - s.from) / double(total), done, std::min(frames, total - done));
+
+		if(auto* h = patch.head())
+		{
+			*h = head;
+			h->timeInSamples = head.timeInSamples + (long long)done;
+			h->timeInSeconds = h->timeInSamples / io.sampleRate;
+			h->ppqPosition = h->timeInSeconds * head.bpm / 60;
+		}
+
+		patch.process(in, io.inputs, out, io.outputs, frames);
+		done += frames;
+
+		for (auto* c : patch.controls)
+			c->settle();
+	}
+
+	std::size_t position() const { return done; }
+
+private:
+
+	void hold()
+	{
+		for (auto& s : settings)
+			patch.control(s.name)->set(s.from);
+	}
+
+	Instance& patch;
+	ape::IOConfig io;
+	std::size_t total, done = 0;
+	std::vector<Setting> settings;
+	ape::PlayHeadPosition head;
+};
\ No newline at end of file
@@ -0,0 +1,78 @@
+//
+//  Signals.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Wav.hpp"
+
+// Fixed test inputs. Everything is computed from the sample index or a
+// seeded xorshift, never std:: distributions, so every machine builds
+// the same bits.
+namespace signals
+{
+	using Signal = std::vector<float>;
+
+	inline Signal silence(std::size_t frames)
+	{
+		return Signal(frames, 0.0f);
+	}
+
+	inline Signal impulse(std::size_t frames, std::size_t at = 0)
+	{
+		Signal s(frames, 0.0f);
+		if(at < frames) s[at] = 1.0f;
+		return s;
+	}
+
+	// exponential sine sweep from f0 to f1 Hz over the whole signal
+	inline Signal sweep(std::size_t frames, double sampleRate, double f0, double f1, float level)
+	{
+		Signal s(frames);
+		const double T = double(frames) / sampleRate;
+		const double k = std::log(f1 / f0);
+		for (std::size_t n = 0; n < frames; ++n)
+		{
+			const double t = double(n) / sampleRate;
+			s[n] = level * float(std::sin(6.283185307179586 * f0 * T / k * (std::exp(t / T * k) - 1)));
+		}
+		return s;
+	}
+
+	// uniform in [-level, level)
+	inline Signal noise(std::size_t frames, std::uint32_t seed, float level)
+	{
+		Signal s(frames);
+		std::uint32_t x = 0x9E3779B9u ^ seed * 2654435761u;
+		for (auto& v : s)
+		{
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			v = level * ((x >> 8) * (2.0f / 16777216.0f) - 1.0f);
+		}
+		return s;
+	}
+
+	// first channel of a WAV, cut or padded with silence to frames
+	inline Signal file(const std::string& path, std::size_t frames)
+	{
+		WavReader wav;
+		if(!wav.open(path))
+			throw std::runtime_error(wav.error());
+		Signal s = std::move(wav.readAll().front());
+		s.resize(frames, 0.0f);
+		return s;
+	}
+}
\ No newline at end of file
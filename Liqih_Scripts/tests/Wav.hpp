@@ -0,0 +1,242 @@
+//
+//  Wav.hpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Streaming RIFF/WAVE reading and writing, a block of frames at a time,
+// so a file of any length costs one block of memory.
+// Reads 16, 24 and 32 bit PCM and 32 bit float, plain or extensible;
+// writes 32 bit float. Samples are planar float on our side, the bytes
+// are put together by hand so the host's endianness does not matter.
+class WavReader
+{
+public:
+
+	WavReader() = default;
+	WavReader(const WavReader&) = delete;
+	WavReader& operator=(const WavReader&) = delete;
+	~WavReader() { close(); }
+
+	// false with error() set when the file is missing or not a format we read
+	bool open(const std::string& path)
+	{
+		close();
+		file = std::fopen(path.c_str(), "rb");
+		if(!file)
+			return fail("cannot open " + path);
+
+		unsigned char riff[12];
+		if(std::fread(riff, 1, 12, file) != 12 || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0)
+			return fail(path + " is not a WAVE file");
+
+		bool formatSeen = false;
+		unsigned char head[8];
+		while(std::fread(head, 1, 8, file) == 8)
+		{
+			const std::uint32_t size = le32(head + 4);
+			if(std::memcmp(head, "fmt ", 4) == 0)
+			{
+				unsigned char fmt[40] {};
+				if(size < 16 || std::fread(fmt, 1, std::min<std::uint32_t>(size, 40), file) != std::min<std::uint32_t>(size, 40))
+					return fail(path + ": short fmt chunk");
+				if(size > 40) std::fseek(file, long(size - 40), SEEK_CUR);
+
+				std::uint16_t tag = le16(fmt);
+				if(tag == EXTENSIBLE && size >= 26)
+					tag = le16(fmt + 24); // the first two bytes of the sub-format GUID
+				count = le16(fmt + 2);
+				rate = le32(fmt + 4);
+				align = le16(fmt + 12);
+				bits = le16(fmt + 14);
+				floating = tag == FLOAT;
+
+				const bool ok = count > 0 && (floating ? bits == 32 : tag == PCM && (bits == 16 || bits == 24 || bits == 32));
+				if(!ok || align != count * (bits / 8))
+					return fail(path + ": unsupported sample format");
+				formatSeen = true;
+			}
+			else if(std::memcmp(head, "data", 4) == 0)
+			{
+				if(!formatSeen)
+					return fail(path + ": data before fmt");
+				remaining = size / align;
+				return true;
+			}
+			else
+			{
+				std::fseek(file, long(size + (size & 1)), SEEK_CUR);
+			}
+		}
+		return fail(path + ": no data chunk");
+	}
+
+	void close()
+	{
+		if(file) std::fclose(file);
+		file = nullptr;
+		remaining = 0;
+	}
+
+	std::size_t channels() const { return count; }
+	double sampleRate() const { return rate; }
+	// frames not read yet
+	std::size_t frames() const { return remaining; }
+	const std::string& error() const { return message; }
+
+	// up to frames samples into out[0 .. channels()), returns how many came
+	std::size_t read(float* const* out, std::size_t frames)
+	{
+		frames = std::min(frames, remaining);
+		raw.resize(frames * align);
+		const std::size_t got = file ? std::fread(raw.data(), align, frames, file) : 0;
+
+		const unsigned char* in = raw.data();
+		for(std::size_t n = 0; n < got; ++n)
+			for(std::size_t c = 0; c < count; ++c, in += bits / 8)
+				out[c][n] = sample(in);
+
+		remaining = got < frames ? 0 : remaining - got;
+		return got;
+	}
+
+	// the whole rest of the file, one vector per channel
+	std::vector<std::vector<float>> readAll()
+	{
+		std::vector<std::vector<float>> planes(count, std::vector<float>(remaining));
+		std::vector<float*> to(count);
+		for(std::size_t c = 0; c < count; ++c) to[c] = planes[c].data();
+
+		const std::size_t got = read(to.data(), remaining);
+		for(auto& p : planes) p.resize(got);
+		return planes;
+	}
+
+private:
+
+	enum : std::uint16_t { PCM = 1, FLOAT = 3, EXTENSIBLE = 0xFFFE };
+
+	static std::uint16_t le16(const unsigned char* b) { return std::uint16_t(b[0] | b[1] << 8); }
+	static std::uint32_t le32(const unsigned char* b) { return std::uint32_t(b[0]) | std::uint32_t(b[1]) << 8 | std::uint32_t(b[2]) << 16 | std::uint32_t(b[3]) << 24; }
+
+	float sample(const unsigned char* b) const
+	{
+		if(floating)
+		{
+			const std::uint32_t bitsOf = le32(b);
+			float x;
+			std::memcpy(&x, &bitsOf, 4);
+			return x;
+		}
+		switch(bits)
+		{
+		case 16: return float(std::int16_t(le16(b))) / 32768.0f;
+		case 24: return float(std::int32_t(std::uint32_t(b[0]) << 8 | std::uint32_t(b[1]) << 16 | std::uint32_t(b[2]) << 24) >> 8) / 8388608.0f;
+		default: return float(double(std::int32_t(le32(b))) / 2147483648.0);
+		}
+	}
+
+	bool fail(std::string why)
+	{
+		close();
+		message = std::move(why);
+		return false;
+	}
+
+	std::FILE* file = nullptr;
+	std::size_t count = 0, align = 0, bits = 0, remaining = 0;
+	double rate = 0;
+	bool floating = false;
+	std::vector<unsigned char> raw;
+	std::string message;
+};
+
+class WavWriter
+{
+public:
+
+	WavWriter() = default;
+	WavWriter(const WavWriter&) = delete;
+	WavWriter& operator=(const WavWriter&) = delete;
+	~WavWriter() { close(); }
+
+	// the header goes out now with zero sizes, close() fills them in
+	bool open(const std::string& path, std::size_t channels, double sampleRate)
+	{
+		close();
+		file = std::fopen(path.c_str(), "wb");
+		if(!file)
+			return false;
+
+		count = channels;
+		written = 0;
+		const std::uint32_t rate = std::uint32_t(sampleRate + 0.5);
+		unsigned char head[HEADER];
+		std::memcpy(head, "RIFF\0\0\0\0WAVEfmt ", 16);
+		put32(head + 16, 16);
+		put16(head + 20, 3); // IEEE float
+		put16(head + 22, std::uint16_t(count));
+		put32(head + 24, rate);
+		put32(head + 28, std::uint32_t(rate * 4 * count));
+		put16(head + 32, std::uint16_t(4 * count));
+		put16(head + 34, 32);
+		std::memcpy(head + 36, "data\0\0\0\0", 8);
+		return std::fwrite(head, 1, HEADER, file) == HEADER;
+	}
+
+	bool write(const float* const* in, std::size_t frames)
+	{
+		raw.resize(frames * count * 4);
+		unsigned char* out = raw.data();
+		for(std::size_t n = 0; n < frames; ++n)
+			for(std::size_t c = 0; c < count; ++c, out += 4)
+			{
+				std::uint32_t bits;
+				std::memcpy(&bits, &in[c][n], 4);
+				put32(out, bits);
+			}
+		written += frames;
+		return file && std::fwrite(raw.data(), 1, raw.size(), file) == raw.size();
+	}
+
+	bool close()
+	{
+		if(!file)
+			return true;
+
+		const std::uint32_t data = std::uint32_t(written * count * 4);
+		unsigned char size[4];
+		bool ok = true;
+		put32(size, data + HEADER - 8);
+		ok &= std::fseek(file, 4, SEEK_SET) == 0 && std::fwrite(size, 1, 4, file) == 4;
+		put32(size, data);
+		ok &= std::fseek(file, 40, SEEK_SET) == 0 && std::fwrite(size, 1, 4, file) == 4;
+		ok &= std::fclose(file) == 0;
+		file = nullptr;
+		return ok;
+	}
+
+private:
+
+	enum { HEADER = 44 };
+
+	static void put16(unsigned char* b, std::uint16_t x) { b[0] = (unsigned char)x; b[1] = (unsigned char)(x >> 8); }
+	static void put32(unsigned char* b, std::uint32_t x) { for (int k = 0; k < 4; ++k) b[k] = (unsigned char)(x >> (8 * k)); }
+
+	std::FILE* file = nullptr;
+	std::size_t count = 0, written = 0;
+	std::vector<unsigned char> raw;
+};
\ No newline at end of file
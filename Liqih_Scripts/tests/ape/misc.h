@@ -0,0 +1,3 @@
+// the scripts include the APE headers by name, they all come from the stand-in
+#pragma once
+#include "runtime.h"
\ No newline at end of file
@@ -0,0 +1,333 @@
+//
+//  runtime.h
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "../Wav.hpp"
+
+// A stand-in for the parts of the APE runtime the scripts use, so they
+// build and run as plain C++ for the tests and the batch renderer.
+// It copies the interfaces the scripts call and nothing else; it is not
+// APE. Where APE's behaviour is richer, the stand-in picks something
+// simple and deterministic:
+// - Param<float> follows a straight line set by the host, operator[](n)
+//   reads it per sample and the plain value is where the block ends. The
+//   line is worked out from the absolute sample, so the block size does
+//   not change what the script reads;
+// - AudioFile reads the first channel of a WAV found next to the script,
+//   at the file's own rate;
+// - abort() throws, the host reports the message.
+namespace ape
+{
+	using fpoint = double;
+
+	template<typename T>
+	struct consts
+	{
+		static constexpr T pi = T(3.14159265358979323846);
+		static constexpr T tau = T(6.28318530717958647692);
+		static constexpr T e = T(2.71828182845904523536);
+		static constexpr T zero = T(0);
+		static constexpr T half = T(0.5);
+		static constexpr T one = T(1);
+		static constexpr T two = T(2);
+	};
+
+	struct dB
+	{
+		template<typename T>
+		static T from(T x) { return std::pow(T(10), x / T(20)); }
+		template<typename T>
+		static T to(T x) { return T(20) * std::log10(x); }
+	};
+
+	[[noreturn]] inline void abort(const char* reason) { throw std::runtime_error(reason); }
+
+	// 4-point, 3rd-order Hermite, x-form; one type for the offset and the taps as in APE
+	template<typename T>
+	inline T hermite4(T offset, T ym1, T y0, T y1, T y2)
+	{
+		const T c0 = y0;
+		const T c1 = T(0.5) * (y1 - ym1);
+		const T c2 = ym1 - T(2.5) * y0 + T(2) * y1 - T(0.5) * y2;
+		const T c3 = T(0.5) * (y2 - ym1) + T(1.5) * (y0 - y1);
+		return ((c3 * offset + c2) * offset + c1) * offset + c0;
+	}
+
+	struct Range
+	{
+		enum Mapping { Lin, Exp };
+
+		Range() = default;
+		Range(double low, double high, Mapping mapping = Lin) : min(low), max(high), map(mapping) {}
+
+		double min = 0, max = 1;
+		Mapping map = Lin;
+	};
+
+	namespace host
+	{
+		// what the host can do to a parameter without knowing its type
+		struct Control
+		{
+			std::string name;
+			virtual ~Control() = default;
+			virtual void set(double value) = 0;
+			// float parameters follow from + step * t for the next frames samples,
+			// t counting samples from the start of the render and at the first
+			// of them; the rest jump to where the block ends
+			virtual void ramp(double from, double step, std::size_t at, std::size_t frames) { set(from + step * double(at + frames)); }
+			virtual void settle() {}
+			virtual double get() const = 0;
+		};
+
+		// filled while a patch is constructed, see Host.hpp
+		inline thread_local std::vector<Control*>* controls = nullptr;
+		inline thread_local std::vector<std::pair<std::string, const float*>>* meters = nullptr;
+		inline thread_local std::string scriptDirectory;
+
+		inline void enlist(Control* c, const char* name)
+		{
+			c->name = name;
+			if(controls) controls->push_back(c);
+		}
+	}
+
+	template<typename T>
+	class Param : public host::Control
+	{
+	public:
+
+		using Names = std::initializer_list<const char*>;
+
+		Param(const char* name, Range = Range()) { host::enlist(this, name); }
+		Param(const char* name, const char* /* unit */, Range = Range()) { host::enlist(this, name); }
+		Param(const char* name, Names) { host::enlist(this, name); }
+
+		Param& operator=(T x) { value = x; return *this; }
+		operator T() const { return value; }
+		T operator[](std::size_t) const { return value; }
+
+		void set(double x) override { value = convert(x); }
+		double get() const override { return double(value); }
+
+	private:
+
+		static T convert(double x)
+		{
+			if constexpr (std::is_same<T, bool>::value)
+				return x >= 0.5;
+			else if constexpr (std::is_enum<T>::value || std::is_integral<T>::value)
+				return static_cast<T>(std::lround(x));
+			else
+				return static_cast<T>(x);
+		}
+
+		T value {};
+	};
+
+	template<>
+	class Param<float> : public host::Control
+	{
+	public:
+
+		Param(const char* name, Range = Range()) { host::enlist(this, name); }
+		Param(const char* name, const char* /* unit */, Range = Range()) { host::enlist(this, name); }
+
+		Param& operator=(float x) { set(x); return *this; }
+		operator float() const { return end; }
+		float operator[](std::size_t n) const { return float(origin + slope * double(at + n + 1)); }
+
+		void set(double x) override
+		{
+			origin = x;
+			slope = 0;
+			end = float(x);
+		}
+		void ramp(double from, double step, std::size_t first, std::size_t frames) override
+		{
+			origin = from;
+			slope = step;
+			at = first;
+			end = float(origin + slope * double(at + frames));
+		}
+		void settle() override { set(end); }
+		double get() const override { return end; }
+
+	private:
+
+		double origin = 0, slope = 0;
+		std::size_t at = 0;
+		float end = 0;
+	};
+
+	class MeteredValue
+	{
+	public:
+
+		MeteredValue(const char* name)
+		{
+			if(host::meters) host::meters->emplace_back(name, &value);
+		}
+		MeteredValue(const MeteredValue& other) = delete;
+
+		MeteredValue& operator=(float x) { value = x; return *this; }
+
+	private:
+
+		float value = 0;
+	};
+
+	template<typename T>
+	class umatrix
+	{
+	public:
+
+		umatrix(T* const* data, std::size_t channels, std::size_t samples) : rows(data), count(channels), length(samples) {}
+
+		T* operator[](std::size_t c) const { return rows[c]; }
+		std::size_t channels() const { return count; }
+		std::size_t samples() const { return length; }
+
+	private:
+
+		T* const* rows;
+		std::size_t count, length;
+	};
+
+	// reads wrap around the ends
+	template<typename T>
+	class circular_signal
+	{
+	public:
+
+		circular_signal(T* data, std::size_t samples) : p(data), n((long long)samples) {}
+
+		T operator()(long long i) const { return p[((i % n) + n) % n]; }
+		std::size_t size() const { return (std::size_t)n; }
+
+	private:
+
+		T* p;
+		long long n;
+	};
+
+	class AudioFile
+	{
+	public:
+
+		AudioFile(const char* name)
+		{
+			WavReader wav;
+			const std::string path = host::scriptDirectory.empty() ? name : host::scriptDirectory + "/" + name;
+			if(!wav.open(path))
+				abort(wav.error().c_str());
+			rate = wav.sampleRate();
+			data = std::move(wav.readAll().front());
+			if(data.empty())
+				data.assign(1, 0.0f);
+		}
+
+		double sampleRate() const { return rate; }
+		std::size_t samples() const { return data.size(); }
+		std::size_t channels() const { return 1; }
+
+		circular_signal<const float> operator[](std::size_t) const { return { data.data(), data.size() }; }
+
+	private:
+
+		std::vector<float> data;
+		double rate = 44100;
+	};
+
+	struct IOConfig
+	{
+		double sampleRate;
+		std::size_t maxBlockSize;
+		std::size_t inputs, outputs;
+	};
+
+	struct PlayHeadPosition
+	{
+		double bpm = 120;
+		int timeSigNumerator = 4, timeSigDenominator = 4;
+		long long timeInSamples = 0;
+		double timeInSeconds = 0, ppqPosition = 0;
+		bool isPlaying = false;
+	};
+
+	class Processor
+	{
+	public:
+
+		virtual ~Processor() = default;
+
+		// host side: remembers the configuration, then the script's start()
+		void begin(const IOConfig& cfg)
+		{
+			io = cfg;
+			start(cfg);
+		}
+
+	protected:
+
+		virtual void start(const IOConfig&) {}
+
+		const IOConfig& config() const { return io; }
+		std::size_t sharedChannels() const { return std::min(io.inputs, io.outputs); }
+
+		// silences output channels [offset, channels)
+		static void clear(umatrix<float>& outputs, std::size_t offset)
+		{
+			for (std::size_t c = offset; c < outputs.channels(); ++c)
+				std::fill(outputs[c], outputs[c] + outputs.samples(), 0.0f);
+		}
+
+	private:
+
+		IOConfig io {};
+	};
+
+	class Effect : public Processor
+	{
+	public:
+
+		virtual void process(umatrix<const float> inputs, umatrix<float> outputs, std::size_t frames) = 0;
+	};
+
+	class TransportEffect : public Effect
+	{
+	public:
+
+		PlayHeadPosition transport; // the host moves it before every block
+
+	protected:
+
+		PlayHeadPosition getPlayHeadPosition() const { return transport; }
+	};
+
+	class Generator : public Processor
+	{
+	public:
+
+		virtual void process(umatrix<float> buffer, std::size_t frames) = 0;
+	};
+}
+
+#define GlobalData(name, description)
\ No newline at end of file
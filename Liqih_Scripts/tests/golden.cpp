@@ -0,0 +1,306 @@
+//
+//  golden.cpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+// Golden-output and null-test suite for the scripts.
+// Every case renders a fixed input through one patch twice: in 512 frame
+// blocks, and in blocks of random size up to MAX_BLOCK. The first render
+// is nulled against the stored golden file, the second against the first,
+// and both residuals must stay under the case's tolerance. Each row also
+// reports how much faster than realtime the 512 frame render ran, so a
+// speedup and its null test come out of the same run.
+//
+//	liqih_golden --golden <dir> [--patch <name>] [--update] [--residuals <dir>]
+//
+// --update rewrites the golden files from the current code, --residuals
+// writes render minus golden for every case that fails.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include "Host.hpp"
+#include "Signals.hpp"
+
+namespace
+{
+	using Planes = std::vector<signals::Signal>;
+
+	constexpr double RATE = 44100;
+	constexpr std::size_t BLOCK = 512, MAX_BLOCK = 4096;
+
+	std::size_t seconds(double s) { return std::size_t(s * RATE); }
+
+	std::string drum(const char* name)
+	{
+		return std::string(LIQIH_SCRIPTS) + "/Drumming/" + name;
+	}
+
+	struct Case
+	{
+		std::string patch, name;
+		double length;       // seconds
+		std::size_t outputs;
+		std::function<Planes(std::size_t frames)> input; // one signal per input channel, none for generators
+		std::vector<Setting> settings;
+		double tolerance;    // dBFS, the largest residual allowed
+		ape::PlayHeadPosition transport {};
+	};
+
+	// tolerances leave room for another compiler's rounding, which feedback
+	// (Echoing), high gain (Fuzzilla) and the pitch tracker's decisions
+	// (Kazootronica) amplify; the players only interpolate
+	std::vector<Case> cases()
+	{
+		ape::PlayHeadPosition playing;
+		playing.isPlaying = true;
+
+		ape::PlayHeadPosition waltz = playing;
+		waltz.bpm = 96;
+		waltz.timeSigNumerator = 3;
+		waltz.timeInSamples = 12345;
+
+		return {
+			{ "Echoing", "impulse", 0.5, 2,
+				[](std::size_t n) { return Planes { signals::impulse(n), signals::impulse(n, 100) }; },
+				{}, -100 },
+			{ "Echoing", "kick_modulated", 0.5, 2,
+				[](std::size_t n) { auto kick = signals::file(drum("KICK 1 CLOSE.wav"), n); return Planes { kick, kick }; },
+				{ { "wow", 0.6, 0.6 }, { "flutter", 0.5, 0.5 }, { "diffuse", 0.7, 0.7 }, { "length", 0.3, 0.6 } }, -100 },
+			{ "Echoing", "ducked", 0.5, 2,
+				[](std::size_t n) {
+					auto key = signals::file(drum("KICK 1 CLOSE.wav"), n);
+					return Planes { signals::noise(n, 1, 0.3f), signals::noise(n, 2, 0.3f), key, key }; },
+				{ { "sidechain", 1, 1 }, { "duck", 0.8, 0.8 }, { "duckRelease", 120, 120 } }, -100 },
+			{ "Fuzzilla", "sweep", 0.5, 2,
+				[](std::size_t n) { auto s = signals::sweep(n, RATE, 40, 12000, 0.5f); return Planes { s, s }; },
+				{}, -90 },
+			{ "Fuzzilla", "snare_automated", 0.5, 2,
+				[](std::size_t n) { auto snare = signals::file(drum("SNARE 2 CLOSE.wav"), n); return Planes { snare, snare }; },
+				{ { "threshold", 0, 1 }, { "gain", 0.5, 1 }, { "halfThru", 1, 1 }, { "limit", 1, 1 } }, -90 },
+			{ "Kazootronica", "sweep", 0.5, 2,
+				[](std::size_t n) { auto s = signals::sweep(n, RATE, 110, 440, 0.5f); return Planes { s, s }; },
+				{}, -80 },
+			{ "Kazootronica", "buzz_vocal", 0.5, 2,
+				[](std::size_t n) { auto s = signals::sweep(n, RATE, 110, 440, 0.5f); return Planes { s, s }; },
+				{ { "buzz", 0, 1 }, { "vocal", 0.8, 0.8 }, { "quantise", 1, 1 }, { "limit", 1, 1 } }, -80 },
+			{ "Drumming", "groove", 1.0, 2,
+				[](std::size_t n) { return Planes { signals::silence(n), signals::silence(n) }; },
+				{ { "Rate1", 15, 15 }, { "Groove1", 1, 1 }, { "Swing1", 0.6, 0.6 }, { "Humanise", 0.5, 0.5 }, { "Seed", 7, 7 } },
+				-120, playing },
+			{ "Drumming", "waltz", 1.0, 2,
+				[](std::size_t n) { return Planes { signals::silence(n), signals::silence(n) }; },
+				{}, -120, waltz },
+			{ "HitsPlaying", "oneshot", 0.5, 2, nullptr,
+				{ { "File2", 1, 1 }, { "Reverse2", 1, 1 }, { "Start2", 0.1, 0.1 }, { "End2", 0.6, 0.6 } }, -120 },
+			{ "HitsPlaying", "stretch", 0.5, 2, nullptr,
+				{ { "File1", 3, 3 }, { "Speed1", 1.3, 1.3 }, { "Beats1", 2, 2 },
+				  { "File2", 1, 1 }, { "Reverse2", 1, 1 }, { "Beats2", 1, 1 }, { "BPM", 140, 140 } }, -120 },
+			{ "WaveshapeOscillator", "sweep", 0.5, 2, nullptr,
+				{ { "Frequency", 80, 800 } }, -120 },
+		};
+	}
+
+	// draws the next block size; the same sequence on every machine
+	class Blocks
+	{
+	public:
+
+		explicit Blocks(std::uint32_t seed) : x(seed | 1) {}
+
+		std::size_t operator()()
+		{
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			return 1 + x % MAX_BLOCK;
+		}
+
+	private:
+
+		std::uint32_t x;
+	};
+
+	// FNV-1a, so the block sizes of a case do not depend on the standard library
+	std::uint32_t hash(const std::string& text)
+	{
+		std::uint32_t h = 2166136261u;
+		for (unsigned char ch : text)
+			h = (h ^ ch) * 16777619u;
+		return h;
+	}
+
+	Planes render(const Case& c, const Planes& input, std::size_t frames, const std::function<std::size_t()>& next)
+	{
+		auto patch = makePatch(c.patch);
+		if(!patch)
+			throw std::runtime_error("no patch named '" + c.patch + "'");
+
+		const ape::IOConfig cfg { RATE, MAX_BLOCK, input.size(), c.outputs };
+		Session session(*patch, cfg, frames, c.settings, c.transport);
+
+		Planes out(c.outputs, signals::Signal(frames, 0.0f));
+		std::vector<const float*> in(cfg.inputs);
+		std::vector<float*> to(cfg.outputs);
+		for (std::size_t pos = 0; pos < frames; )
+		{
+			const std::size_t n = std::min(next(), frames - pos);
+			for (std::size_t ch = 0; ch < cfg.inputs; ++ch) in[ch] = input[ch].data() + pos;
+			for (std::size_t ch = 0; ch < cfg.outputs; ++ch) to[ch] = out[ch].data() + pos;
+			session.block(in.data(), to.data(), n);
+			pos += n;
+		}
+		return out;
+	}
+
+	struct Residual
+	{
+		double peak = 0, rms = 0; // dBFS
+		bool comparable = true;   // same channels and length
+	};
+
+	double toDB(double x) { return 20 * std::log10(std::max(x, 1e-15)); }
+
+	Residual null(const Planes& a, const Planes& b)
+	{
+		Residual r;
+		if(a.size() != b.size() || (!a.empty() && a[0].size() != b[0].size()))
+		{
+			r.comparable = false;
+			return r;
+		}
+
+		double peak = 0, sum = 0;
+		std::size_t count = 0;
+		for (std::size_t ch = 0; ch < a.size(); ++ch)
+			for (std::size_t n = 0; n < a[ch].size(); ++n)
+			{
+				const double d = double(a[ch][n]) - double(b[ch][n]);
+				peak = std::max(peak, std::fabs(d));
+				sum += d * d;
+				++count;
+			}
+		r.peak = toDB(peak);
+		r.rms = toDB(std::sqrt(sum / std::max<std::size_t>(count, 1)));
+		return r;
+	}
+
+	bool save(const std::string& path, const Planes& planes)
+	{
+		WavWriter wav;
+		std::vector<const float*> from;
+		for (auto& p : planes) from.push_back(p.data());
+		return wav.open(path, planes.size(), RATE) && wav.write(from.data(), planes.empty() ? 0 : planes[0].size()) && wav.close();
+	}
+
+	bool load(const std::string& path, Planes& planes)
+	{
+		WavReader wav;
+		if(!wav.open(path))
+			return false;
+		planes = wav.readAll();
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string goldenDir, residualDir, only;
+	bool update = false;
+	for (int a = 1; a < argc; ++a)
+	{
+		const std::string arg = argv[a];
+		if(arg == "--update") update = true;
+		else if(arg == "--golden" && a + 1 < argc) goldenDir = argv[++a];
+		else if(arg == "--residuals" && a + 1 < argc) residualDir = argv[++a];
+		else if(arg == "--patch" && a + 1 < argc) only = argv[++a];
+		else
+		{
+			std::fprintf(stderr, "usage: %s --golden <dir> [--patch <name>] [--update] [--residuals <dir>]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(goldenDir.empty())
+	{
+		std::fprintf(stderr, "--golden <dir> is required\n");
+		return 2;
+	}
+
+	std::printf("%-34s %10s %10s %10s %10s %9s\n", "case", "peak dB", "rms dB", "blocks dB", "limit dB", "x rt");
+
+	int failed = 0, ran = 0;
+	for (const Case& c : cases())
+	{
+		if(!only.empty() && c.patch != only)
+			continue;
+		++ran;
+
+		const std::string id = c.patch + "." + c.name;
+		try
+		{
+			const std::size_t frames = seconds(c.length);
+			const Planes input = c.input ? c.input(frames) : Planes {};
+
+			const auto t0 = std::chrono::steady_clock::now();
+			const Planes fixed = render(c, input, frames, [] { return BLOCK; });
+			const double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+			Blocks blocks(hash(id));
+			const Planes varied = render(c, input, frames, std::ref(blocks));
+			const Residual invariance = null(fixed, varied);
+			const double speed = c.length / std::max(took, 1e-9);
+
+			const std::string golden = goldenDir + "/" + id + ".wav";
+			if(update)
+			{
+				if(!save(golden, fixed))
+					throw std::runtime_error("cannot write " + golden);
+				std::printf("%-34s %10s %10s %10.1f %10.0f %9.1f  written\n", id.c_str(), "", "", invariance.peak, c.tolerance, speed);
+				continue;
+			}
+
+			Planes stored;
+			if(!load(golden, stored))
+				throw std::runtime_error("no golden file " + golden + ", run with --update");
+
+			const Residual r = null(fixed, stored);
+			const bool pass = r.comparable && r.peak <= c.tolerance && invariance.peak <= c.tolerance;
+			if(!r.comparable)
+				std::printf("%-34s %10s %10s %10.1f %10.0f %9.1f  FAIL (shape differs from golden)\n", id.c_str(), "-", "-", invariance.peak, c.tolerance, speed);
+			else
+				std::printf("%-34s %10.1f %10.1f %10.1f %10.0f %9.1f  %s\n", id.c_str(), r.peak, r.rms, invariance.peak, c.tolerance, speed, pass ? "ok" : "FAIL");
+
+			if(!pass)
+			{
+				++failed;
+				if(!residualDir.empty() && r.comparable)
+				{
+					Planes diff = fixed;
+					for (std::size_t ch = 0; ch < diff.size(); ++ch)
+						for (std::size_t n = 0; n < diff[ch].size(); ++n)
+							diff[ch][n] -= stored[ch][n];
+					save(residualDir + "/" + id + ".residual.wav", diff);
+				}
+			}
+		}
+		catch(const std::exception& e)
+		{
+			std::printf("%-34s FAIL: %s\n", id.c_str(), e.what());
+			++failed;
+		}
+	}
+
+	if(ran == 0)
+	{
+		std::fprintf(stderr, "no case matches '%s'\n", only.c_str());
+		return 2;
+	}
+	return failed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,4 @@
+#include "../../Drumming/Drumming.hpp"
+#include "../Host.hpp"
+
+LIQIH_PATCH(Drumming, "/Drumming")
\ No newline at end of file
@@ -0,0 +1,4 @@
+#include "../../Echoing.hpp"
+#include "../Host.hpp"
+
+LIQIH_PATCH(Echoing, "")
\ No newline at end of file
@@ -0,0 +1,4 @@
+#include "../../Fuzzilla.hpp"
+#include "../Host.hpp"
+
+LIQIH_PATCH(Fuzzilla, "")
\ No newline at end of file
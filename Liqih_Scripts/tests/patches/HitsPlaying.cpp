@@ -0,0 +1,4 @@
+#include "../../Drumming/hits_file_loaded.hpp"
+#include "../Host.hpp"
+
+LIQIH_PATCH(HitsPlaying, "/Drumming")
\ No newline at end of file
@@ -0,0 +1,4 @@
+#include "../../Kazootronica.hpp"
+#include "../Host.hpp"
+
+LIQIH_PATCH(Kazootronica, "")
\ No newline at end of file
@@ -0,0 +1,4 @@
+#include "../../Drumming/waveshape_oscillator.hpp"
+#include "../Host.hpp"
+
+LIQIH_PATCH(WaveshapeOscillator, "/Drumming")
\ No newline at end of file
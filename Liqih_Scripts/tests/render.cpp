@@ -0,0 +1,277 @@
+//
+//  render.cpp
+//
+//
+//  License:
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+
+// Offline batch renderer: runs a list of jobs through the scripts on the
+// APE stand-in, as fast as the machine goes.
+//
+//	liqih_render <job list> [--threads <n>] [--block <frames>]
+//
+// One job per line, # starts a comment, double quotes keep spaces:
+//
+//	<patch> <input.wav | -> <output.wav> [control=value | control=from:to | @option=value]...
+//
+// A control given as from:to moves in a straight line over the render.
+// Options:
+//	@seconds  length when there is no input file, or added after it as a tail
+//	@rate     sample rate when there is no input file, default 44100
+//	@outputs  output channels, default the input's, 2 with no input
+//	@bpm @meter @start  transport for scripts that follow one: tempo,
+//	          time signature as 3/4, first sample; it is always playing
+//
+// Jobs are shared out over the threads, one script instance each. Input
+// and output are streamed a block at a time, so a job costs a few blocks
+// of memory however long the file is. Blocks default to 8192 frames.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include "Host.hpp"
+#include "Wav.hpp"
+
+namespace
+{
+	struct Job
+	{
+		int line = 0;
+		std::string patch, input, output;
+		std::vector<Setting> settings;
+		double seconds = 0, rate = 44100;
+		std::size_t outputs = 0;
+		ape::PlayHeadPosition transport;
+	};
+
+	std::vector<std::string> split(const std::string& text)
+	{
+		std::vector<std::string> words;
+		std::string word;
+		bool quoted = false, any = false;
+		for (char ch : text)
+		{
+			if(ch == '"') { quoted = !quoted; any = true; }
+			else if(!quoted && ch == '#') break;
+			else if(!quoted && (ch == ' ' || ch == '\t' || ch == '\r'))
+			{
+				if(any) words.push_back(word);
+				word.clear();
+				any = false;
+			}
+			else { word += ch; any = true; }
+		}
+		if(any) words.push_back(word);
+		return words;
+	}
+
+	double number(const std::string& text, const std::string& what)
+	{
+		std::size_t used = 0;
+		double x = 0;
+		try { x = std::stod(text, &used); } catch(...) { used = 0; }
+		if(used != text.size() || text.empty())
+			throw std::runtime_error("'" + text + "' is not a number for " + what);
+		return x;
+	}
+
+	Job parse(const std::vector<std::string>& words, int line)
+	{
+		if(words.size() < 3)
+			throw std::runtime_error("needs <patch> <input> <output>");
+
+		Job job;
+		job.line = line;
+		job.patch = words[0];
+		job.input = words[1] == "-" ? "" : words[1];
+		job.output = words[2];
+		job.transport.isPlaying = true;
+
+		for (std::size_t w = 3; w < words.size(); ++w)
+		{
+			const std::string& word = words[w];
+			const auto eq = word.find('=');
+			if(eq == std::string::npos || eq == 0)
+				throw std::runtime_error("'" + word + "' is not name=value");
+			const std::string name = word.substr(0, eq), value = word.substr(eq + 1);
+
+			if(name == "@seconds") job.seconds = number(value, name);
+			else if(name == "@rate") job.rate = number(value, name);
+			else if(name == "@outputs") job.outputs = std::size_t(number(value, name));
+			else if(name == "@bpm") job.transport.bpm = number(value, name);
+			else if(name == "@start") job.transport.timeInSamples = (long long)number(value, name);
+			else if(name == "@meter")
+			{
+				const auto slash = value.find('/');
+				if(slash == std::string::npos)
+					throw std::runtime_error("@meter wants a time signature like 3/4");
+				job.transport.timeSigNumerator = int(number(value.substr(0, slash), name));
+				job.transport.timeSigDenominator = int(number(value.substr(slash + 1), name));
+			}
+			else if(name[0] == '@')
+				throw std::runtime_error("unknown option " + name);
+			else
+			{
+				const auto colon = value.find(':');
+				const double from = number(value.substr(0, colon), name);
+				const double to = colon == std::string::npos ? from : number(value.substr(colon + 1), name);
+				job.settings.push_back({ name, from, to });
+			}
+		}
+		if(job.input.empty() && job.seconds <= 0)
+			throw std::runtime_error("no input file, so @seconds is needed");
+		return job;
+	}
+
+	// returns the seconds of audio rendered
+	double run(const Job& job, std::size_t block)
+	{
+		auto patch = makePatch(job.patch);
+		if(!patch)
+			throw std::runtime_error("no patch named '" + job.patch + "'");
+
+		WavReader source;
+		std::size_t inputs = 0, fromFile = 0;
+		double rate = job.rate;
+		if(!job.input.empty())
+		{
+			if(patch->generator())
+				throw std::runtime_error(job.patch + " is a generator and takes no input, use -");
+			if(!source.open(job.input))
+				throw std::runtime_error(source.error());
+			inputs = source.channels();
+			fromFile = source.frames();
+			rate = source.sampleRate();
+		}
+		else if(!patch->generator())
+		{
+			inputs = job.outputs ? job.outputs : 2; // silence in, for the transport players
+		}
+
+		const std::size_t outputs = job.outputs ? job.outputs : inputs ? inputs : 2;
+		const std::size_t total = fromFile + std::size_t(job.seconds * rate + 0.5);
+
+		const ape::IOConfig cfg { rate, block, inputs, outputs };
+		Session session(*patch, cfg, total, job.settings, job.transport);
+
+		WavWriter sink;
+		if(!sink.open(job.output, outputs, rate))
+			throw std::runtime_error("cannot write " + job.output);
+
+		std::vector<std::vector<float>> in(inputs, std::vector<float>(block)), out(outputs, std::vector<float>(block));
+		std::vector<float*> inPtr, outPtr;
+		for (auto& v : in) inPtr.push_back(v.data());
+		for (auto& v : out) outPtr.push_back(v.data());
+
+		for (std::size_t done = 0; done < total; )
+		{
+			const std::size_t frames = std::min(block, total - done);
+			const std::size_t got = done < fromFile ? source.read(inPtr.data(), std::min(frames, fromFile - done)) : 0;
+			for (auto& v : in) std::fill(v.begin() + got, v.begin() + frames, 0.0f); // the tail, or a short file
+			for (auto& v : out) std::fill(v.begin(), v.begin() + frames, 0.0f);
+
+			session.block(inPtr.data(), outPtr.data(), frames);
+			if(!sink.write(outPtr.data(), frames))
+				throw std::runtime_error("cannot write " + job.output);
+			done += frames;
+		}
+		if(!sink.close())
+			throw std::runtime_error("cannot finish " + job.output);
+		return total / rate;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string list;
+	std::size_t threads = std::max(1u, std::thread::hardware_concurrency()), block = 8192;
+	for (int a = 1; a < argc; ++a)
+	{
+		const std::string arg = argv[a];
+		if(arg == "--threads" && a + 1 < argc) threads = std::max(1, std::atoi(argv[++a]));
+		else if(arg == "--block" && a + 1 < argc) block = std::max(1, std::atoi(argv[++a]));
+		else if(list.empty() && arg[0] != '-') list = arg;
+		else
+		{
+			std::fprintf(stderr, "usage: %s <job list> [--threads <n>] [--block <frames>]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	std::ifstream file(list);
+	if(list.empty() || !file)
+	{
+		std::fprintf(stderr, "cannot read the job list '%s'\n", list.c_str());
+		return 2;
+	}
+
+	// every line is checked before anything renders
+	std::vector<Job> jobs;
+	int bad = 0, line = 0;
+	for (std::string text; std::getline(file, text); )
+	{
+		++line;
+		const auto words = split(text);
+		if(words.empty())
+			continue;
+		try
+		{
+			jobs.push_back(parse(words, line));
+		}
+		catch(const std::exception& e)
+		{
+			std::fprintf(stderr, "%s:%d: %s\n", list.c_str(), line, e.what());
+			++bad;
+		}
+	}
+	if(bad)
+		return 2;
+
+	std::atomic<std::size_t> next { 0 };
+	std::atomic<int> failed { 0 };
+	std::mutex print;
+	const auto t0 = std::chrono::steady_clock::now();
+	double audio = 0;
+
+	auto worker = [&]
+	{
+		for (std::size_t j; (j = next++) < jobs.size(); )
+		{
+			const Job& job = jobs[j];
+			const auto start = std::chrono::steady_clock::now();
+			try
+			{
+				const double seconds = run(job, block);
+				const double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				std::lock_guard<std::mutex> lock(print);
+				audio += seconds;
+				std::printf("%s:%d: %s -> %s, %.1f s of audio, %.0fx realtime\n", list.c_str(), job.line,
+					job.patch.c_str(), job.output.c_str(), seconds, seconds / std::max(took, 1e-9));
+			}
+			catch(const std::exception& e)
+			{
+				std::lock_guard<std::mutex> lock(print);
+				std::fprintf(stderr, "%s:%d: %s failed: %s\n", list.c_str(), job.line, job.patch.c_str(), e.what());
+				++failed;
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (std::size_t t = 1; t < std::min(threads, jobs.size()); ++t)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& t : pool)
+		t.join();
+
+	const double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	std::printf("%zu jobs, %d failed, %.1f s of audio in %.2f s\n", jobs.size(), failed.load(), audio, took);
+	return failed ? 1 : 0;
+}
\ No newline at end of file